@@ -2,169 +2,817 @@
 #define AI_H
 
 #include <limits.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <time.h>
 
 #include "board.h"
+#include "eval.h"
 #include "moves.h"
+#include "movepicker.h"
+#include "stats.h"
+#include "timeman.h"
+#include "tt.h"
 
-#define MAX_DEPTH 5
+// Limits for getComputerMove. Define MAX_DEPTH as well to stop at a fixed
+// depth within the time.
 #define MAX_SECONDS 5
 
-#ifdef MAX_SECONDS
-#define MAX_CLOCKS (MAX_SECONDS * CLOCKS_PER_SEC)
-clock_t deadline;
-#endif
+// Size of the transposition table; initTT() can resize it later.
+#define TT_SIZE_MB TT_DEFAULT_MB
+
+#define MAX_PLY 64
+
+// Deepest iteration ever started, leaving room in the per-ply tables for
+// the helper threads' extra ply and the quiescence search.
+#define MAX_SEARCH_DEPTH (MAX_PLY - 4)
+
+// The limits of the current search, and the time budget derived from them.
+struct searchLimits search_limits;
+struct timeManager time_manager;
+
+// Statistics of the current or last search, summed over all threads (see
+// collectStats). The per-iteration figures are the main thread's.
+struct searchStats search_stats;
+
+// Set once a limit is reached, or once the main thread has finished. It can
+// also be set from outside the search, from another thread. Every search
+// thread polls it. Scores from then on are not trustworthy: they are
+// discarded, and kept out of the transposition table.
+bool search_stopped = false;
+
+static inline bool stopRequested()
+{
+    return __atomic_load_n(&search_stopped, __ATOMIC_RELAXED);
+}
+
+static inline void requestStop()
+{
+    __atomic_store_n(&search_stopped, true, __ATOMIC_RELAXED);
+}
+
+// Set while a ponder search ignores its limits (see searchLimits.ponder).
+bool search_pondering = false;
+
+static inline bool isPondering()
+{
+    return __atomic_load_n(&search_pondering, __ATOMIC_RELAXED);
+}
+
+// The opponent played the move being pondered on: start keeping to the
+// limits. Time already spent counts, since the clock started at the search.
+static inline void ponderHit()
+{
+    __atomic_store_n(&search_pondering, false, __ATOMIC_RELAXED);
+}
+
+/*
+ * What the main thread reports after each completed iteration: the depth,
+ * the score from the side to move's point of view, the nodes searched by
+ * all threads so far, the time taken, the principal variation and the
+ * search statistics so far.
+ */
+struct searchReport
+{
+    int depth;
+    int score;
+    long long int nodes;
+    double seconds;
+    const struct move *pv;
+    int pv_length;
+    const struct searchStats *stats;
+};
+
+// Called with each report if set, e.g. to print UCI info lines.
+void (*report_iteration)(const struct searchReport *report) = NULL;
+
+/*
+ * Everything one search thread needs for itself. With Lazy SMP, several
+ * threads search the same root at once, sharing nothing but the
+ * transposition table; the helpers' only job is to fill it with results
+ * the main thread can use.
+ * https://www.chessprogramming.org/Lazy_SMP
+ */
+struct searchThread
+{
+    int id;
+    pthread_t thread;
+    struct board b;
+
+    // Quiet moves that caused a beta cutoff, by ply from the root.
+    struct move killer_moves[MAX_PLY][N_KILLERS];
+
+    // The move played at each ply of the current line, for counter-moves.
+    struct move move_stack[MAX_PLY];
+
+    /*
+     * Butterfly history: for each side and each (from, to) pair, how often
+     * a quiet move caused a beta cutoff, weighted towards deeper searches.
+     * https://www.chessprogramming.org/History_Heuristic
+     */
+    int history[2][64][64];
+
+    /*
+     * Counter-moves: the quiet move that refuted the opponent's last move,
+     * indexed by the color, type and destination of the piece that moved.
+     * https://www.chessprogramming.org/Countermove_Heuristic
+     */
+    struct move counter_moves[2][7][64];
+
+    /*
+     * Triangular PV table: pv[ply] holds the best line found from ply
+     * onwards in the current node, up to (not including) pv_length[ply].
+     * https://www.chessprogramming.org/Triangular_PV-Table
+     */
+    struct move pv[MAX_PLY][MAX_PLY];
+    int pv_length[MAX_PLY];
+
+    // The principal variation of the last completed iteration, and
+    // whether the current node is still on it.
+    struct move pv_line[MAX_PLY];
+    int pv_line_length;
+    bool follow_pv;
+
+    // Generator for the random tie-breaks between root moves.
+    uint64_t rng;
+
+    struct searchStats stats;
+    struct move best_move;
+    int best_score;
+};
+
+/*
+ * Search features that can be switched off at run time, to compare node
+ * counts and play with and without them.
+ */
+struct searchOptions
+{
+    bool null_move;
+    bool lmr;
+};
+
+struct searchOptions search_options = {
+    .null_move = true,
+    .lmr = true,
+};
+
+// Number of search threads, including the main one. Change with setThreads().
+int n_search_threads = 0;
+struct searchThread *search_threads = NULL;
 
-int eval_counter = 0;
+uint64_t search_seed;
+
+void setThreads(int n)
+{
+    free(search_threads);
+    n_search_threads = MAX(n, 1);
+
+    // calloc would not keep the NNUE accumulators in the boards aligned
+    size_t size = n_search_threads * sizeof(struct searchThread);
+    search_threads = aligned_alloc(_Alignof(struct searchThread), size);
+    memset(search_threads, 0, size);
+    for (int i = 0; i < n_search_threads; i++)
+    {
+        search_threads[i].id = i;
+    }
+}
 
 void initComputer()
 {
-    srand(time(NULL));
+    search_seed = time(NULL);
+    initTT(TT_SIZE_MB);
+    setThreads(1);
+}
+
+// Being mated scores -MATE_SCORE plus the number of plies until mate, so
+// that a quicker mate is preferred. Scores beyond MATE_BOUND are mates.
+#define MATE_SCORE 100000
+#define MATE_BOUND (MATE_SCORE - MAX_PLY)
+
+// Beyond every score a search can return, for the edges of a full window.
+// Kept well clear of INT_MAX so that window arithmetic cannot overflow.
+#define SCORE_INFINITE (MATE_SCORE + 1)
+
+// Mate scores are stored in the transposition table relative to the node
+// they were found at, not to the root, since the same position can be
+// reached at different plies.
+int scoreToTT(int score, int ply)
+{
+    if (score >= MATE_BOUND) { return score + ply; }
+    if (score <= -MATE_BOUND) { return score - ply; }
+    return score;
+}
+
+int scoreFromTT(int score, int ply)
+{
+    if (score >= MATE_BOUND) { return score - ply; }
+    if (score <= -MATE_BOUND) { return score + ply; }
+    return score;
 }
 
-int evaluate(struct board *b)
+void storeKiller(struct searchThread *t, int ply, struct move m)
 {
-    int total = 0;
-    int color = b->white_to_move ? WHITE : BLACK;
+    struct move *killers = t->killer_moves[ply];
+    if (movesEqual(&killers[0], &m)) { return; }
 
-    for (int i = 0; i < 64; i++)
+    killers[1] = killers[0];
+    killers[0] = m;
+}
+
+// History scores stay within +-HISTORY_MAX (see updateHistory).
+#define HISTORY_MAX 16384
+
+// Move a history score towards +-HISTORY_MAX by bonus. The closer it
+// already is, the smaller the step, so scores never overflow.
+void updateHistory(int *entry, int bonus)
+{
+    *entry += bonus - *entry * abs(bonus) / HISTORY_MAX;
+}
+
+/*
+ * Reward a quiet move that caused a beta cutoff, and penalise the quiet
+ * moves searched before it that did not.
+ */
+void updateQuietStats(struct searchThread *t, int depth, int ply, struct move m,
+        const struct move *tried, int n_tried)
+{
+    const struct board *b = &t->b;
+    int (*side_history)[64] = t->history[b->white_to_move ? 1 : 0];
+    int bonus = MIN(depth * depth, 400);
+
+    storeKiller(t, ply, m);
+    updateHistory(&side_history[moveFrom(m)][moveTo(m)], bonus);
+    for (int i = 0; i < n_tried; i++)
     {
-        int piece = b->pieces[i];
+        updateHistory(&side_history[moveFrom(tried[i])][moveTo(tried[i])], -bonus);
+    }
 
-        int value = 0;
-        switch (piece & PIECE_TYPE)
-        {
-            case KING:
-                value = 1000000;
-                break;
-
-            // From L. Kaufman,
-            // via https://www.chessprogramming.org/Point_Value
-            case QUEEN:
-                value = 1000;
-                break;
-            case ROOK:
-                value = 525;
-                break;
-            case KNIGHT:
-                value = 350;
-                break;
-            case BISHOP:
-                value = 350;
-                break;
-            case PAWN:
-                value = 100;
-                break;
-        }
+    struct move prev_move = (ply > 0) ? t->move_stack[ply - 1] : NO_MOVE;
+    if (prev_move.data != NO_MOVE.data)
+    {
+        int piece = b->pieces[moveTo(prev_move)];
+        t->counter_moves[COLOR_INDEX(piece & PIECE_COLOR)][piece & PIECE_TYPE][moveTo(prev_move)] = m;
+    }
+}
+
+// The counter-move stored for the move that led to the current position.
+struct move counterMove(const struct searchThread *t, int ply)
+{
+    // No counter-move at the root, or after a null move
+    struct move prev_move = (ply > 0) ? t->move_stack[ply - 1] : NO_MOVE;
+    if (prev_move.data == NO_MOVE.data) { return NO_MOVE; }
 
-        if ((piece & PIECE_COLOR) == color) { total += value; }
-        else { total -= value; }
+    int piece = t->b.pieces[moveTo(prev_move)];
+    return t->counter_moves[COLOR_INDEX(piece & PIECE_COLOR)][piece & PIECE_TYPE][moveTo(prev_move)];
+}
+
+// A new best move at ply: the PV from here is m followed by the child's PV.
+void updatePV(struct searchThread *t, int ply, struct move m)
+{
+    t->pv[ply][ply] = m;
+    for (int i = ply + 1; i < t->pv_length[ply + 1]; i++)
+    {
+        t->pv[ply][i] = t->pv[ply + 1][i];
     }
+    t->pv_length[ply] = MAX(t->pv_length[ply + 1], ply + 1);
+}
 
-    eval_counter++;
-    return total;
+// Nodes searched so far by all threads. Helpers are still counting, so
+// this is only approximate during a search.
+long long int totalNodes()
+{
+    long long int nodes = 0;
+    for (int i = 0; i < n_search_threads; i++)
+    {
+        nodes += __atomic_load_n(&search_threads[i].stats.nodes, __ATOMIC_RELAXED);
+    }
+    return nodes;
 }
 
-int runSearch(struct board *b, int depth, int alpha, int beta, struct move *best_move)
+// Nodes searched between checks of the clock. Must be a power of two.
+#define POLL_INTERVAL 1024
+
+/*
+ * Count a node, and every so often check whether the hard time limit or
+ * the node limit, which counts the nodes of all threads, has been reached.
+ * Only the main thread checks; it then stops the others.
+ */
+static inline void countNode(struct searchThread *t)
 {
-    if (depth == 0)
+    long long int nodes = ++t->stats.nodes;
+    if (t->id != 0 || (nodes & (POLL_INTERVAL - 1)) != 0) { return; }
+    if (search_limits.infinite || isPondering()) { return; }
+
+    if (elapsedSeconds(&time_manager) > time_manager.hard
+            || (search_limits.nodes > 0 && totalNodes() >= search_limits.nodes))
     {
+        requestStop();
+    }
+}
+
+// In quiescence search, a capture is skipped if even winning the captured
+// piece and this much more would leave the score below alpha.
+#define DELTA_MARGIN 200
+
+/*
+ * Quiescence search: at the end of the main search, keep searching captures
+ * and promotions until the position is quiet, so that it is never scored in
+ * the middle of an exchange. The side to move may also "stand pat" on the
+ * static evaluation instead of capturing. When in check, every evasion is
+ * searched instead, since standing pat is not an option then.
+ * https://www.chessprogramming.org/Quiescence_Search
+ */
+int quiesce(struct searchThread *t, int ply, int alpha, int beta)
+{
+    struct board *b = &t->b;
+    countNode(t);
+    STAT_INC(&t->stats, qnodes);
+    if (stopRequested()) { return 0; }
+
+    struct movePicker mp;
+    initMovePicker(&mp, b, NO_MOVE, NULL, NO_MOVE, NULL);
+    bool in_check = (mp.l.checkers != 0);
+    mp.noisy_only = !in_check;
+    t->pv_length[ply] = ply;
+
+    if (ply >= MAX_PLY - 1)
+    {
+        STAT_INC(&t->stats, evals);
         return evaluate(b);
     }
 
-    struct moveList ml_instance;
-    struct moveList *ml = &ml_instance;
-    init_movelist(ml);
-    genAllMoves(b, ml);
+    if (!in_check) { STAT_INC(&t->stats, evals); }
+    int stand_pat = in_check ? -MATE_SCORE + ply : evaluate(b);
+
+    int best_score = stand_pat;
+    if (best_score >= beta) { return best_score; }
+    alpha = MAX(alpha, best_score);
 
-    if (ml->n_moves == 0)
+    struct move m;
+    while ((m = nextMove(&mp)).data != NO_MOVE.data)
     {
-        // Note: it has to be -INT_MAX, not INT_MIN,
-        // because -INT_MIN is undefined behavior!
-        return isKingInCheck(b) ? -INT_MAX : 0;
+        // Delta pruning: skip captures that cannot raise the score to alpha
+        if (!in_check && movePromotion(m) == NONE)
+        {
+            int victim = (moveFlags(m) == MOVE_EP_CAPTURE) ? PAWN : (b->pieces[moveTo(m)] & PIECE_TYPE);
+            if (stand_pat + material_values[victim] + DELTA_MARGIN <= alpha) { continue; }
+        }
+
+        struct undo u = applyMove(b, m);
+        int score = -quiesce(t, ply+1, -beta, -alpha);
+        undoMove(b, m, u);
+        if (stopRequested()) { return 0; }
+
+        if (score > best_score)
+        {
+            best_score = score;
+            if (score >= beta) { break; }
+            alpha = MAX(alpha, score);
+        }
     }
 
-    int best_score = INT_MIN;
-    int best_index = -1;
+    return best_score;
+}
+
+/*
+ * Null-move pruning: if the side to move could pass and a reduced search
+ * still fails high, a real move almost certainly would too. The reduction
+ * grows with depth. Passing is only better than moving in zugzwang, which
+ * is mostly a danger in pawn endings, so it is not tried without pieces.
+ * https://www.chessprogramming.org/Null_Move_Pruning
+ */
+#define NULL_MOVE_MIN_DEPTH 3
+
+static inline int nullMoveReduction(int depth)
+{
+    return 2 + depth / 4;
+}
+
+static inline bool hasNonPawnMaterial(const struct board *b)
+{
+    const uint64_t *own = b->bitboards[b->white_to_move ? 1 : 0];
+    return (own[NONE] & ~own[PAWN] & ~own[KING]) != 0;
+}
 
-    // Do a basic shuffle by repeatedly swapping moves around.
-    for (int i_move = 0; i_move < ml->n_moves; i_move++)
+/*
+ * Late move reductions: quiet moves that the move ordering put late are
+ * unlikely to be best, so they are searched to a reduced depth first, and
+ * only searched in full if that fails high.
+ * https://www.chessprogramming.org/Late_Move_Reductions
+ */
+#define LMR_MIN_DEPTH 3
+#define LMR_MIN_MOVES 3
+
+static inline int lateMoveReduction(int depth, int n_searched)
+{
+    int r = 1 + (n_searched >= 8) + (depth >= 6);
+    return MIN(r, depth - 2);
+}
+
+/*
+ * This search algorithm is "negamax" with alpha-beta pruning, as a
+ * Principal Variation Search: once one move has been searched, the rest
+ * are only checked, with a null window, to be no better than it. A move
+ * that turns out better is searched again with the full window.
+ * https://en.wikipedia.org/wiki/Negamax
+ * https://www.chessprogramming.org/Principal_Variation_Search
+ */
+int runSearch(struct searchThread *t, int depth, int ply, int alpha, int beta, struct move *best_move)
+{
+    if (depth == 0)
     {
-        int rand_index = rand() % ml->n_moves;
+        return quiesce(t, ply, alpha, beta);
+    }
+
+    struct board *b = &t->b;
+    bool pv_node = (alpha + 1 < beta);
+    t->pv_length[ply] = ply;
+
+    countNode(t);
+    if (ply > 0 && stopRequested()) { return 0; }
 
-        struct move m = ml->moves[i_move];
-        ml->moves[i_move] = ml->moves[rand_index];
-        ml->moves[rand_index] = m;
+    // If best_move is already populated with something that is legal here,
+    // consider that a guess, and try it first. Next best is the move from
+    // the last iteration's PV, then the best move from the transposition table.
+    struct move hash_move = best_move ? *best_move : NO_MOVE;
+    bool on_pv = t->follow_pv && ply < t->pv_line_length;
+    if (hash_move.data == NO_MOVE.data && on_pv)
+    {
+        hash_move = t->pv_line[ply];
     }
+    int alpha_orig = alpha;
 
-    // If best_move is already populated with something that matches
-    // one of our moves, consider that a guess, and put it first.
-    if (best_move != NULL)
+    struct ttEntry entry;
+    STAT_INC(&t->stats, tt_probes);
+    if (probeTT(b->hash, &entry))
     {
-        for (int i_move = 0; i_move < ml->n_moves; i_move++)
+        STAT_INC(&t->stats, tt_hits);
+        if (hash_move.data == NO_MOVE.data)
         {
-            struct move *m = &(ml->moves[i_move]);
-            if (movesEqual(m, best_move))
+            hash_move = entry.move;
+        }
+
+        // PV nodes (including the root, which has to come up with a move)
+        // never stop here, so that the PV is not cut short.
+        if (!pv_node && entry.depth >= depth)
+        {
+            int score = scoreFromTT(entry.score, ply);
+            if (entry.bound == BOUND_EXACT
+                    || (entry.bound == BOUND_LOWER && score >= beta)
+                    || (entry.bound == BOUND_UPPER && score <= alpha))
             {
-                struct move m = ml->moves[i_move];
-                ml->moves[i_move] = ml->moves[0];
-                ml->moves[0] = m;
+                STAT_INC(&t->stats, tt_cutoffs);
+                return score;
+            }
+        }
+    }
+
+    struct movePicker mp;
+    initMovePicker(&mp, b, hash_move, t->killer_moves[ply], counterMove(t, ply),
+            t->history[b->white_to_move ? 1 : 0]);
+    if (ply == 0) { mp.tie_rng = &t->rng; }
+    bool in_check = (mp.l.checkers != 0);
 
-                break;
+    // Never two null moves in a row: that would just search this node again
+    bool after_null = (ply > 0 && t->move_stack[ply - 1].data == NO_MOVE.data);
+    if (search_options.null_move && !pv_node && !in_check && !after_null
+            && depth >= NULL_MOVE_MIN_DEPTH && hasNonPawnMaterial(b))
+    {
+        STAT_INC(&t->stats, evals);
+        if (evaluate(b) >= beta)
+        {
+            t->move_stack[ply] = NO_MOVE;
+            struct undo u = applyNullMove(b);
+            int r = nullMoveReduction(depth);
+            STAT_INC(&t->stats, null_tries);
+            int score = -runSearch(t, MAX(depth - 1 - r, 0), ply+1, -beta, -beta+1, NULL);
+            undoNullMove(b, u);
+            if (stopRequested()) { return 0; }
+
+            // Don't trust a mate found by passing
+            if (score >= beta)
+            {
+                STAT_INC(&t->stats, null_cutoffs);
+                return (score >= MATE_BOUND) ? beta : score;
             }
         }
     }
 
-    // This search algorithm is "negamax" with alpha-beta pruning.
-    // https://en.wikipedia.org/wiki/Negamax
-    for (int i_move = 0; i_move < ml->n_moves; i_move++)
+    int best_score = INT_MIN;
+    struct move best = NO_MOVE;
+    struct move m;
+
+    struct move quiets_tried[MAX_MOVES];
+    int n_quiets_tried = 0;
+    int n_searched = 0;
+
+    while ((m = nextMove(&mp)).data != NO_MOVE.data)
     {
-        struct move m = ml->moves[i_move];
-        struct board b2 = *b;
+        bool quiet = !moveIsCapture(m) && movePromotion(m) == NONE;
+
+        t->move_stack[ply] = m;
+        t->follow_pv = on_pv && movesEqual(&m, &t->pv_line[ply]);
+        struct undo u = applyMove(b, m);
+
+        int score;
+        if (n_searched == 0)
+        {
+            score = -runSearch(t, depth-1, ply+1, -beta, -alpha, NULL);
+        }
+        else
+        {
+            // Moves from the quiet stage have been outscored by the hash
+            // move, killers and counter-move already
+            int reduction = 0;
+            if (search_options.lmr && quiet && mp.stage == STAGE_QUIET && !in_check
+                    && depth >= LMR_MIN_DEPTH && n_searched >= LMR_MIN_MOVES
+                    && !isKingInCheck(b))
+            {
+                reduction = lateMoveReduction(depth, n_searched);
+            }
+
+            score = -runSearch(t, depth-1-reduction, ply+1, -alpha-1, -alpha, NULL);
+            if (reduction > 0)
+            {
+                STAT_INC(&t->stats, lmr_tries);
+                if (score > alpha)
+                {
+                    score = -runSearch(t, depth-1, ply+1, -alpha-1, -alpha, NULL);
+                }
+                else
+                {
+                    STAT_INC(&t->stats, lmr_successes);
+                }
+            }
+            if (score > alpha && score < beta)
+            {
+                score = -runSearch(t, depth-1, ply+1, -beta, -alpha, NULL);
+            }
+        }
 
-        applyMove(&b2, m);
+        undoMove(b, m, u);
+        t->follow_pv = false;
 
-        int score = -runSearch(&b2, depth-1, -beta, -alpha, NULL);
+        // The last move's search was cut short, so its score means nothing
+        if (stopRequested()) { break; }
+        n_searched++;
 
         if (score > best_score)
         {
             best_score = score;
-            best_index = i_move;
+            best = m;
+            if (score > alpha) { updatePV(t, ply, m); }
         }
 
         alpha = MAX(alpha, best_score);
-        if (alpha >= beta) { break; }
+        if (alpha >= beta)
+        {
+            STAT_INC(&t->stats, fail_highs);
+            if (n_searched == 1) { STAT_INC(&t->stats, fail_highs_first); }
+            if (quiet)
+            {
+                updateQuietStats(t, depth, ply, m, quiets_tried, n_quiets_tried);
+            }
+            break;
+        }
 
-#ifdef MAX_SECONDS
-        if (clock() > deadline) { break; }
-#endif
+        if (quiet) { quiets_tried[n_quiets_tried++] = m; }
     }
 
+    if (stopRequested())
+    {
+        // Only moves whose search finished have been counted. At the root,
+        // one that raised alpha is proven better than the previous best.
+        if (best_move != NULL && best.data != NO_MOVE.data && best_score > alpha_orig)
+        {
+            *best_move = best;
+            return best_score;
+        }
+        return 0;
+    }
+
+    if (best.data == NO_MOVE.data)
+    {
+        return isKingInCheck(b) ? -MATE_SCORE + ply : 0;
+    }
+
+    int bound = (best_score <= alpha_orig) ? BOUND_UPPER
+        : (best_score >= beta) ? BOUND_LOWER
+        : BOUND_EXACT;
+    storeTT(b->hash, depth, scoreToTT(best_score, ply), bound, best);
+
     // If this is the top level, provide the move itself, not just the score
     if (best_move != NULL)
     {
-        *best_move = ml->moves[best_index];
+        *best_move = best;
     }
 
     return best_score;
 }
 
-struct move getComputerMove(struct board *b)
+/*
+ * Aspiration windows: from this depth on, each iteration starts with a
+ * narrow window around the previous iteration's score, which prunes more
+ * if the score holds. If it falls outside, the window is widened on that
+ * side, doubling each time, until it gives way to the full window.
+ * https://www.chessprogramming.org/Aspiration_Windows
+ */
+#define ASPIRATION_DEPTH 4
+#define ASPIRATION_WINDOW 50
+#define ASPIRATION_MAX 800
+
+// Sum every thread's counters into search_stats. Like totalNodes(), only
+// approximate while the helpers are still searching.
+void collectStats()
 {
-    eval_counter = 0;
-    struct move m;
+    clearCounters(&search_stats);
+    for (int i = 0; i < n_search_threads; i++)
+    {
+        addStats(&search_stats, &search_threads[i].stats);
+    }
+}
 
-#ifdef MAX_SECONDS
-    deadline = clock() + MAX_CLOCKS;
-#endif
+// Iterative deepening from depth first_depth to last_depth.
+void iterativeDeepening(struct searchThread *t, int first_depth, int last_depth)
+{
+    t->pv_line_length = 0;
+    t->best_score = 0;
+
+    for (int depth = first_depth; depth <= last_depth && !stopRequested(); depth++)
+    {
+        int delta = ASPIRATION_WINDOW;
+        int alpha = -SCORE_INFINITE;
+        int beta = SCORE_INFINITE;
+        if (depth >= ASPIRATION_DEPTH && abs(t->best_score) < MATE_BOUND)
+        {
+            alpha = t->best_score - delta;
+            beta = t->best_score + delta;
+        }
+
+        while (true)
+        {
+            t->follow_pv = true;
+            struct move m = t->best_move;
+            int score = runSearch(t, depth, 0, alpha, beta, &m);
+
+            // An unfinished iteration only counts if it has already found
+            // a better move than the last one.
+            if (stopRequested())
+            {
+                if (!movesEqual(&m, &t->best_move))
+                {
+                    t->best_move = m;
+                    t->best_score = score;
+                    memcpy(t->pv_line, t->pv[0], sizeof(t->pv_line));
+                    t->pv_line_length = t->pv_length[0];
+                }
+                return;
+            }
+
+            // On a fail low, every root move is only known to be worse than
+            // alpha, so the move found is no better a choice than the last.
+            if (score <= alpha)
+            {
+                beta = alpha + (beta - alpha) / 2;
+                alpha = (delta > ASPIRATION_MAX) ? -SCORE_INFINITE : MAX(score - delta, -SCORE_INFINITE);
+                delta *= 2;
+                continue;
+            }
+
+            t->best_move = m;
+            t->best_score = score;
+            memcpy(t->pv_line, t->pv[0], sizeof(t->pv_line));
+            t->pv_line_length = t->pv_length[0];
+
+            if (score >= beta)
+            {
+                beta = (delta > ASPIRATION_MAX) ? SCORE_INFINITE : MIN(score + delta, SCORE_INFINITE);
+                delta *= 2;
+                continue;
+            }
+            break;
+        }
+
+        if (t->id != 0) { continue; }
+
+        double seconds = elapsedSeconds(&time_manager);
+        long long int nodes = totalNodes();
+        recordIteration(&search_stats, depth, nodes, seconds);
+
+        if (report_iteration != NULL)
+        {
+            collectStats();
+            struct searchReport report = {
+                .depth = depth,
+                .score = t->best_score,
+                .nodes = nodes,
+                .seconds = seconds,
+                .pv = t->pv_line,
+                .pv_length = t->pv_line_length,
+                .stats = &search_stats,
+            };
+            report_iteration(&report);
+        }
 
-    // Iterative deepening from depth 1 to our max depth.
-    for (int depth = 1; depth <= MAX_DEPTH; depth++)
+        // Past the soft limit, the next iteration would likely not finish
+        if (!isPondering() && seconds > time_manager.soft)
+        {
+            break;
+        }
+    }
+}
+
+/*
+ * Helper threads run the same iterative deepening as the main thread, but
+ * half of them start a ply deeper, and each breaks ties between root moves
+ * differently, so that they do not all search the same nodes in lockstep.
+ */
+void *helperThread(void *arg)
+{
+    struct searchThread *t = arg;
+    int last_depth = search_limits.depth > 0 ? search_limits.depth : MAX_SEARCH_DEPTH;
+    iterativeDeepening(t, 1 + t->id % 2, MIN(last_depth, MAX_SEARCH_DEPTH) + 1);
+    return NULL;
+}
+
+/*
+ * Clear the stop and ponder flags for a search with the given limits. Call
+ * this before searchPosition(), on the thread that may later call
+ * requestStop() or ponderHit(): if the search thread cleared them itself,
+ * a stop or ponderhit sent before it got going would be lost.
+ */
+void prepareSearch(const struct searchLimits *limits)
+{
+    __atomic_store_n(&search_stopped, false, __ATOMIC_RELAXED);
+    __atomic_store_n(&search_pondering, limits->ponder, __ATOMIC_RELAXED);
+}
+
+/*
+ * Search b within the given limits and return the best move found. The
+ * search can be cut short from another thread with requestStop(). Call
+ * prepareSearch() first.
+ */
+struct move searchPosition(struct board *b, const struct searchLimits *limits)
+{
+    search_limits = *limits;
+    initTimeManager(&time_manager, limits);
+    newSearchTT();
+
+    for (int i = 0; i < n_search_threads; i++)
     {
-        runSearch(b, depth, -INT_MAX, INT_MAX, &m);
+        struct searchThread *t = &search_threads[i];
+        t->b = *b;
+        memset(t->killer_moves, 0, sizeof(t->killer_moves));
+        memset(t->history, 0, sizeof(t->history));
+        memset(t->counter_moves, 0, sizeof(t->counter_moves));
+        t->rng = (search_seed + i) * 0x9e3779b97f4a7c15ULL | 1;
+        clearStats(&t->stats);
+        t->best_move = NO_MOVE;
     }
-    return m;
+    search_seed++;
+    clearStats(&search_stats);
+
+    for (int i = 1; i < n_search_threads; i++)
+    {
+        pthread_create(&search_threads[i].thread, NULL, helperThread, &search_threads[i]);
+    }
+
+    // The main thread decides the move; once it is done, so are the helpers.
+    int last_depth = limits->depth > 0 ? limits->depth : MAX_SEARCH_DEPTH;
+    iterativeDeepening(&search_threads[0], 1, MIN(last_depth, MAX_SEARCH_DEPTH));
+    requestStop();
+
+    for (int i = 1; i < n_search_threads; i++)
+    {
+        pthread_join(search_threads[i].thread, NULL);
+    }
+    collectStats();
+
+    // Stopped before the first iteration finished: any legal move will do
+    struct move best = search_threads[0].best_move;
+    if (best.data == NO_MOVE.data)
+    {
+        struct moveList ml;
+        init_movelist(&ml);
+        genAllMoves(b, &ml);
+        if (ml.n_moves > 0) { best = ml.moves[0]; }
+    }
+
+    return best;
+}
+
+struct move getComputerMove(struct board *b)
+{
+    struct searchLimits limits = {
+#ifdef MAX_DEPTH
+        .depth = MAX_DEPTH,
+#endif
+#ifdef MAX_SECONDS
+        .move_time = MAX_SECONDS,
+#endif
+    };
+    prepareSearch(&limits);
+    return searchPosition(b, &limits);
 }
 
 #endif // AI_H
@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "board.h"
+#include "moves.h"
+#include "ai.h"
+
+/*
+ * Search a fixed set of positions to a fixed depth and report the total
+ * node count and the speed. The search is single-threaded, starts from an
+ * empty transposition table and uses the same seed for its move-ordering
+ * tie-breaks every time, so the node count is the same on every run: it
+ * changes only when the search itself does. The speed is the number to
+ * watch for performance regressions.
+ *
+ * Usage: ./bench [depth]
+ */
+
+#define DEFAULT_BENCH_DEPTH 11
+#define BENCH_SEED 0
+#define BENCH_TT_MB 16
+
+const char *bench_positions[] = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+    "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+    "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+    "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+    "r1bqkb1r/pppp1ppp/2n2n2/4p3/2B1P3/5N2/PPPP1PPP/RNBQK2R w KQkq - 4 4",
+    "r2q1rk1/pp2bppp/2n1bn2/3p4/3P4/2NBBN2/PP3PPP/R2Q1RK1 w - - 0 11",
+    "2r3k1/pp3ppp/4p3/3p4/3P4/4PN2/PP3PPP/2R3K1 w - - 0 20",
+    "8/5pk1/6p1/8/3R4/6P1/5PK1/3r4 b - - 0 40",
+    "8/8/4k3/8/2PK4/8/8/8 w - - 0 60",
+};
+
+int main(int argc, char **argv)
+{
+    int depth = (argc > 1) ? atoi(argv[1]) : DEFAULT_BENCH_DEPTH;
+    int n_positions = sizeof(bench_positions) / sizeof(bench_positions[0]);
+
+    struct board b;
+    init_board(&b);
+    initComputer();
+    initTT(BENCH_TT_MB);
+    setThreads(1);
+
+    long long int total_nodes = 0;
+    double total_seconds = 0;
+
+    for (int i = 0; i < n_positions; i++)
+    {
+        init_board(&b);
+        apply_FEN(&b, bench_positions[i]);
+
+        clearTT();
+        search_seed = BENCH_SEED;
+        struct searchLimits limits = { .depth = depth };
+
+        prepareSearch(&limits);
+        double start = monotonicSeconds();
+        struct move m = searchPosition(&b, &limits);
+        double seconds = monotonicSeconds() - start;
+
+        char move_str[6];
+        moveString(m, move_str);
+        printf("Position %2d/%d: bestmove %-5s nodes %10lld  %6.2fs\n",
+                i + 1, n_positions, move_str, search_stats.nodes, seconds);
+
+        total_nodes += search_stats.nodes;
+        total_seconds += seconds;
+    }
+
+    printf("\nDepth: %d\n", depth);
+    printf("Nodes searched: %lld\n", total_nodes);
+    printf("Time: %.3f s\n", total_seconds);
+    printf("Nodes/second: %.0f\n", total_nodes / total_seconds);
+    return 0;
+}
@@ -0,0 +1,301 @@
+#ifndef BITBOARD_H
+#define BITBOARD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
+
+/*
+ * A bitboard is a 64-bit set of squares: bit (rank*8 + file) is set when
+ * the square is in the set. So a1 is bit 0, h1 is bit 7 and h8 is bit 63.
+ * https://www.chessprogramming.org/Bitboards
+ */
+
+#define SQUARE(rank, file)  ((rank) * 8 + (file))
+#define RANK_OF(sq)         ((sq) >> 3)
+#define FILE_OF(sq)         ((sq) & 7)
+#define SQUARE_BB(sq)       (1ULL << (sq))
+
+#define RANK_1_BB   0x00000000000000ffULL
+#define RANK_8_BB   0xff00000000000000ULL
+#define FILE_A_BB   0x0101010101010101ULL
+#define FILE_H_BB   0x8080808080808080ULL
+
+static inline int popcount(uint64_t bb)
+{
+    return __builtin_popcountll(bb);
+}
+
+// Index of the least significant set bit. bb must not be empty.
+static inline int bitscan(uint64_t bb)
+{
+    return __builtin_ctzll(bb);
+}
+
+// Index of the most significant set bit. bb must not be empty.
+static inline int bitscanReverse(uint64_t bb)
+{
+    return 63 - __builtin_clzll(bb);
+}
+
+// Remove the least significant set bit and return its index.
+static inline int popLSB(uint64_t *bb)
+{
+    int sq = bitscan(*bb);
+    *bb &= *bb - 1;
+    return sq;
+}
+
+uint64_t knight_attacks[64];
+uint64_t king_attacks[64];
+
+// Squares attacked by a pawn of the given color index (0 black, 1 white).
+uint64_t pawn_attacks[2][64];
+
+// Rays from each square in each of the eight directions, excluding the
+// square itself. The first four directions run towards higher squares.
+#define DIR_N   0
+#define DIR_E   1
+#define DIR_NE  2
+#define DIR_NW  3
+#define DIR_S   4
+#define DIR_W   5
+#define DIR_SW  6
+#define DIR_SE  7
+
+uint64_t rays[8][64];
+
+// Squares strictly between two squares on a shared rank, file or diagonal,
+// and the whole line through them; both are empty for unaligned squares.
+uint64_t between_bb[64][64];
+uint64_t line_bb[64][64];
+
+static const int ray_offsets[8][2] = {
+    { 1, 0 }, { 0, 1 }, { 1, 1 }, { 1, -1 },
+    { -1, 0 }, { 0, -1 }, { -1, -1 }, { -1, 1 },
+};
+
+static uint64_t offsetsToBitboard(int sq, const int offsets[][2], int n_offsets)
+{
+    uint64_t bb = 0;
+    for (int i = 0; i < n_offsets; i++)
+    {
+        int rank = RANK_OF(sq) + offsets[i][0];
+        int file = FILE_OF(sq) + offsets[i][1];
+        if (rank < 0 || rank > 7 || file < 0 || file > 7) { continue; }
+        bb |= SQUARE_BB(SQUARE(rank, file));
+    }
+    return bb;
+}
+
+// Attacks along one ray, stopping at (and including) the first blocker.
+static inline uint64_t rayAttacks(int dir, int sq, uint64_t occupied)
+{
+    uint64_t attacks = rays[dir][sq];
+    uint64_t blockers = attacks & occupied;
+    if (blockers)
+    {
+        int blocker = (dir < DIR_S) ? bitscan(blockers) : bitscanReverse(blockers);
+        attacks ^= rays[dir][blocker];
+    }
+    return attacks;
+}
+
+static uint64_t rookAttacksSlow(int sq, uint64_t occupied)
+{
+    return rayAttacks(DIR_N, sq, occupied) | rayAttacks(DIR_E, sq, occupied)
+        | rayAttacks(DIR_S, sq, occupied) | rayAttacks(DIR_W, sq, occupied);
+}
+
+static uint64_t bishopAttacksSlow(int sq, uint64_t occupied)
+{
+    return rayAttacks(DIR_NE, sq, occupied) | rayAttacks(DIR_NW, sq, occupied)
+        | rayAttacks(DIR_SW, sq, occupied) | rayAttacks(DIR_SE, sq, occupied);
+}
+
+/*
+ * Sliding attacks are looked up in tables. Only the "relevant" occupancy
+ * matters for a slider - the squares on its rays, minus the board edge -
+ * and that subset is mapped to a dense table index, either with the BMI2
+ * PEXT instruction or, portably, with a "magic" multiply and shift.
+ * https://www.chessprogramming.org/Magic_Bitboards
+ */
+struct magic
+{
+    uint64_t mask;
+    uint64_t magic;
+    uint64_t *attacks;
+    int shift;
+};
+
+struct magic rook_magics[64];
+struct magic bishop_magics[64];
+
+uint64_t rook_table[102400];
+uint64_t bishop_table[5248];
+
+static inline unsigned magicIndex(const struct magic *m, uint64_t occupied)
+{
+#ifdef __BMI2__
+    return (unsigned) _pext_u64(occupied, m->mask);
+#else
+    return (unsigned) (((occupied & m->mask) * m->magic) >> m->shift);
+#endif
+}
+
+static inline uint64_t rookAttacks(int sq, uint64_t occupied)
+{
+    const struct magic *m = &rook_magics[sq];
+    return m->attacks[magicIndex(m, occupied)];
+}
+
+static inline uint64_t bishopAttacks(int sq, uint64_t occupied)
+{
+    const struct magic *m = &bishop_magics[sq];
+    return m->attacks[magicIndex(m, occupied)];
+}
+
+static inline uint64_t queenAttacks(int sq, uint64_t occupied)
+{
+    return rookAttacks(sq, occupied) | bishopAttacks(sq, occupied);
+}
+
+// xorshift64*. Callers seed it with constants so that the numbers drawn
+// (magics, hash keys) are always the same.
+static uint64_t random64(uint64_t *state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 2685821657736338717ULL;
+}
+
+/*
+ * Fill the attack table for each square of one slider type, finding a magic
+ * number for each square by trial and error (unless PEXT does the indexing).
+ */
+static void initMagics(struct magic *magics, uint64_t *table, bool rook)
+{
+    static uint64_t occupancy[4096];
+    static uint64_t reference[4096];
+    static int epoch[4096];
+    // Per-rank seeds known to find magics quickly (from Stockfish).
+    static const uint64_t seeds[8] = { 728, 10316, 55013, 32803, 12281, 15100, 16645, 255 };
+    uint64_t seed = 0;
+    int attempt = 0;
+
+    for (int sq = 0; sq < 64; sq++)
+    {
+        struct magic *m = &magics[sq];
+        uint64_t edges = ((RANK_1_BB | RANK_8_BB) & ~(RANK_1_BB << (8 * RANK_OF(sq))))
+            | ((FILE_A_BB | FILE_H_BB) & ~(FILE_A_BB << FILE_OF(sq)));
+
+        m->mask = (rook ? rookAttacksSlow(sq, 0) : bishopAttacksSlow(sq, 0)) & ~edges;
+        m->shift = 64 - popcount(m->mask);
+        m->attacks = (sq == 0) ? table : magics[sq - 1].attacks + (1 << (64 - magics[sq - 1].shift));
+
+        // Enumerate every subset of the mask (Carry-Rippler trick).
+        int size = 0;
+        uint64_t subset = 0;
+        do
+        {
+            occupancy[size] = subset;
+            reference[size] = rook ? rookAttacksSlow(sq, subset) : bishopAttacksSlow(sq, subset);
+            size++;
+            subset = (subset - m->mask) & m->mask;
+        } while (subset);
+
+#ifdef __BMI2__
+        for (int i = 0; i < size; i++)
+        {
+            m->attacks[magicIndex(m, occupancy[i])] = reference[i];
+        }
+#else
+        // Try sparse random numbers until one maps every subset to a slot
+        // without a destructive collision.
+        seed = seeds[RANK_OF(sq)];
+        int i = 0;
+        while (i < size)
+        {
+            do
+            {
+                m->magic = random64(&seed) & random64(&seed) & random64(&seed);
+            } while (popcount((m->mask * m->magic) >> 56) < 6);
+
+            attempt++;
+            for (i = 0; i < size; i++)
+            {
+                unsigned index = magicIndex(m, occupancy[i]);
+                if (epoch[index] < attempt)
+                {
+                    epoch[index] = attempt;
+                    m->attacks[index] = reference[i];
+                }
+                else if (m->attacks[index] != reference[i])
+                {
+                    break;
+                }
+            }
+        }
+#endif
+    }
+}
+
+void initAttackTables()
+{
+    static bool initialized = false;
+    if (initialized) { return; }
+    initialized = true;
+
+    static const int knight_offsets[8][2] = {
+        { -1, -2 }, { 1, -2 }, { -1, 2 }, { 1, 2 },
+        { -2, -1 }, { 2, -1 }, { -2, 1 }, { 2, 1 },
+    };
+    static const int black_pawn_offsets[2][2] = { { -1, -1 }, { -1, 1 } };
+    static const int white_pawn_offsets[2][2] = { { 1, -1 }, { 1, 1 } };
+
+    for (int sq = 0; sq < 64; sq++)
+    {
+        knight_attacks[sq] = offsetsToBitboard(sq, knight_offsets, 8);
+        king_attacks[sq] = offsetsToBitboard(sq, ray_offsets, 8);
+        pawn_attacks[0][sq] = offsetsToBitboard(sq, black_pawn_offsets, 2);
+        pawn_attacks[1][sq] = offsetsToBitboard(sq, white_pawn_offsets, 2);
+
+        for (int dir = 0; dir < 8; dir++)
+        {
+            rays[dir][sq] = 0;
+            int rank = RANK_OF(sq) + ray_offsets[dir][0];
+            int file = FILE_OF(sq) + ray_offsets[dir][1];
+            while (rank >= 0 && rank <= 7 && file >= 0 && file <= 7)
+            {
+                rays[dir][sq] |= SQUARE_BB(SQUARE(rank, file));
+                rank += ray_offsets[dir][0];
+                file += ray_offsets[dir][1];
+            }
+        }
+    }
+
+    for (int sq = 0; sq < 64; sq++)
+    {
+        for (int dir = 0; dir < 8; dir++)
+        {
+            // The opposite direction is always four entries away
+            uint64_t line = rays[dir][sq] | rays[dir ^ 4][sq] | SQUARE_BB(sq);
+            uint64_t ray = rays[dir][sq];
+            while (ray)
+            {
+                int other = popLSB(&ray);
+                between_bb[sq][other] = rays[dir][sq] & rays[dir ^ 4][other];
+                line_bb[sq][other] = line;
+            }
+        }
+    }
+
+    initMagics(rook_magics, rook_table, true);
+    initMagics(bishop_magics, bishop_table, false);
+}
+
+#endif // BITBOARD_H
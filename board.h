@@ -6,6 +6,9 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "bitboard.h"
+#include "nnue.h"
+
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
 
@@ -23,6 +26,9 @@
 #define WHITE       0x20
 #define PIECE_COLOR 0x30
 
+// Index into per-color arrays: BLACK -> 0, WHITE -> 1
+#define COLOR_INDEX(color) ((color) >> 5)
+
 #define CASTLE_WK   0x01
 #define CASTLE_WQ   0x02
 #define CASTLE_BK   0x04
@@ -37,19 +43,375 @@ struct coord
 struct board
 {
     int pieces[64];
+
+    // One occupancy set per color and piece type, kept in sync with pieces[]
+    // by set_square. bitboards[c][NONE] holds every piece of that color.
+    uint64_t bitboards[2][7];
+
+    // The squares holding each color's pieces, in no particular order,
+    // and where each occupied square sits in its color's list. A legal
+    // position never has more than 16 pieces of one color, so a piece must
+    // be removed before another is added when both happen in one move.
+    int piece_list[2][16];
+    int piece_count[2];
+    int list_index[64];
+    int king_sq[2];
+
     bool white_to_move;
     int castles_available;
     struct coord ep_target;
+
+    // Zobrist key of the position, kept up to date incrementally.
+    uint64_t hash;
+
+    // Material and piece-square scores from white's point of view, for
+    // the middlegame and the endgame, and how much material is left to
+    // tell the two apart (see psqt_mg and phase_weights). Also kept up to
+    // date incrementally.
+    int mg_score;
+    int eg_score;
+    int phase;
+
+    // The NNUE first layer for this position, kept up to date incrementally
+    // while a network is loaded (see nnue.h and refreshAccumulator).
+    struct nnueAccumulator accumulator;
+};
+
+/*
+ * Zobrist hashing: the key of a position is the XOR of a random number for
+ * each (piece, square) pair on the board, one for the side to move, one for
+ * the castling rights and one for the en-passant file. Making a move then
+ * only has to XOR in and out the terms that changed.
+ * https://www.chessprogramming.org/Zobrist_Hashing
+ */
+uint64_t zobrist_pieces[2][7][64];
+uint64_t zobrist_black_to_move;
+uint64_t zobrist_castles[16];
+uint64_t zobrist_ep_file[8];
+
+void initZobrist()
+{
+    static bool initialized = false;
+    if (initialized) { return; }
+    initialized = true;
+
+    uint64_t seed = 0x3243f6a8885a308dULL;
+
+    for (int c = 0; c < 2; c++)
+    {
+        for (int type = PAWN; type <= KING; type++)
+        {
+            for (int sq = 0; sq < 64; sq++)
+            {
+                zobrist_pieces[c][type][sq] = random64(&seed);
+            }
+        }
+    }
+
+    zobrist_black_to_move = random64(&seed);
+
+    // Castling rights are hashed as a whole, so that any combination of
+    // rights lost in one move costs a single XOR.
+    for (int i = 0; i < 16; i++)
+    {
+        zobrist_castles[i] = random64(&seed);
+    }
+
+    for (int file = 0; file < 8; file++)
+    {
+        zobrist_ep_file[file] = random64(&seed);
+    }
+}
+
+static inline uint64_t zobristPiece(int piece, int sq)
+{
+    return zobrist_pieces[COLOR_INDEX(piece)][piece & PIECE_TYPE][sq];
+}
+
+static inline uint64_t zobristEP(struct coord ep_target)
+{
+    return (ep_target.rank >= 0 && ep_target.file >= 0) ? zobrist_ep_file[ep_target.file] : 0;
+}
+
+/*
+ * Piece-square tables: the value of each piece on each square, as material
+ * plus a positional bonus, for the middlegame (mg) and the endgame (eg).
+ * The evaluation blends the two according to the game phase, which starts
+ * at PHASE_MAX with all pieces on the board and falls as they come off.
+ * https://www.chessprogramming.org/Piece-Square_Tables
+ * https://www.chessprogramming.org/Tapered_Eval
+ *
+ * The positional bonuses are from Tomasz Michniewski's "Simplified
+ * Evaluation Function", with an extra endgame table for pawns.
+ * https://www.chessprogramming.org/Simplified_Evaluation_Function
+ * They are laid out as seen from white's side, rank 8 first.
+ */
+#define PHASE_MAX 24
+
+static const int phase_weights[7] = {
+    [KNIGHT] = 1,
+    [BISHOP] = 1,
+    [ROOK] = 2,
+    [QUEEN] = 4,
+};
+
+// From L. Kaufman, via https://www.chessprogramming.org/Point_Value
+static const int material_values[7] = {
+    [PAWN] = 100,
+    [KNIGHT] = 350,
+    [BISHOP] = 350,
+    [ROOK] = 525,
+    [QUEEN] = 1000,
+    [KING] = 0,
+};
+
+static const int pst_pawn[64] = {
+      0,   0,   0,   0,   0,   0,   0,   0,
+     50,  50,  50,  50,  50,  50,  50,  50,
+     10,  10,  20,  30,  30,  20,  10,  10,
+      5,   5,  10,  25,  25,  10,   5,   5,
+      0,   0,   0,  20,  20,   0,   0,   0,
+      5,  -5, -10,   0,   0, -10,  -5,   5,
+      5,  10,  10, -20, -20,  10,  10,   5,
+      0,   0,   0,   0,   0,   0,   0,   0,
+};
+
+static const int pst_pawn_eg[64] = {
+      0,   0,   0,   0,   0,   0,   0,   0,
+     80,  80,  80,  80,  80,  80,  80,  80,
+     50,  50,  50,  50,  50,  50,  50,  50,
+     30,  30,  30,  30,  30,  30,  30,  30,
+     15,  15,  15,  15,  15,  15,  15,  15,
+      5,   5,   5,   5,   5,   5,   5,   5,
+      0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,
+};
+
+static const int pst_knight[64] = {
+    -50, -40, -30, -30, -30, -30, -40, -50,
+    -40, -20,   0,   0,   0,   0, -20, -40,
+    -30,   0,  10,  15,  15,  10,   0, -30,
+    -30,   5,  15,  20,  20,  15,   5, -30,
+    -30,   0,  15,  20,  20,  15,   0, -30,
+    -30,   5,  10,  15,  15,  10,   5, -30,
+    -40, -20,   0,   5,   5,   0, -20, -40,
+    -50, -40, -30, -30, -30, -30, -40, -50,
+};
+
+static const int pst_bishop[64] = {
+    -20, -10, -10, -10, -10, -10, -10, -20,
+    -10,   0,   0,   0,   0,   0,   0, -10,
+    -10,   0,   5,  10,  10,   5,   0, -10,
+    -10,   5,   5,  10,  10,   5,   5, -10,
+    -10,   0,  10,  10,  10,  10,   0, -10,
+    -10,  10,  10,  10,  10,  10,  10, -10,
+    -10,   5,   0,   0,   0,   0,   5, -10,
+    -20, -10, -10, -10, -10, -10, -10, -20,
 };
 
+static const int pst_rook[64] = {
+      0,   0,   0,   0,   0,   0,   0,   0,
+      5,  10,  10,  10,  10,  10,  10,   5,
+     -5,   0,   0,   0,   0,   0,   0,  -5,
+     -5,   0,   0,   0,   0,   0,   0,  -5,
+     -5,   0,   0,   0,   0,   0,   0,  -5,
+     -5,   0,   0,   0,   0,   0,   0,  -5,
+     -5,   0,   0,   0,   0,   0,   0,  -5,
+      0,   0,   0,   5,   5,   0,   0,   0,
+};
+
+static const int pst_queen[64] = {
+    -20, -10, -10,  -5,  -5, -10, -10, -20,
+    -10,   0,   0,   0,   0,   0,   0, -10,
+    -10,   0,   5,   5,   5,   5,   0, -10,
+     -5,   0,   5,   5,   5,   5,   0,  -5,
+      0,   0,   5,   5,   5,   5,   0,  -5,
+    -10,   5,   5,   5,   5,   5,   0, -10,
+    -10,   0,   5,   0,   0,   0,   0, -10,
+    -20, -10, -10,  -5,  -5, -10, -10, -20,
+};
+
+static const int pst_king[64] = {
+    -30, -40, -40, -50, -50, -40, -40, -30,
+    -30, -40, -40, -50, -50, -40, -40, -30,
+    -30, -40, -40, -50, -50, -40, -40, -30,
+    -30, -40, -40, -50, -50, -40, -40, -30,
+    -20, -30, -30, -40, -40, -30, -30, -20,
+    -10, -20, -20, -20, -20, -20, -20, -10,
+     20,  20,   0,   0,   0,   0,  20,  20,
+     20,  30,  10,   0,   0,  10,  30,  20,
+};
+
+static const int pst_king_eg[64] = {
+    -50, -40, -30, -20, -20, -30, -40, -50,
+    -30, -20, -10,   0,   0, -10, -20, -30,
+    -30, -10,  20,  30,  30,  20, -10, -30,
+    -30, -10,  30,  40,  40,  30, -10, -30,
+    -30, -10,  30,  40,  40,  30, -10, -30,
+    -30, -10,  20,  30,  30,  20, -10, -30,
+    -30, -30,   0,   0,   0,   0, -30, -30,
+    -50, -30, -30, -30, -30, -30, -30, -50,
+};
+
+// Material plus table bonus for each color, piece type and square, signed
+// so that black's pieces count against white.
+int psqt_mg[2][7][64];
+int psqt_eg[2][7][64];
+
+void initPSQT()
+{
+    static bool initialized = false;
+    if (initialized) { return; }
+    initialized = true;
+
+    static const int *mg_tables[7] = {
+        [PAWN] = pst_pawn, [KNIGHT] = pst_knight, [BISHOP] = pst_bishop,
+        [ROOK] = pst_rook, [QUEEN] = pst_queen, [KING] = pst_king,
+    };
+    static const int *eg_tables[7] = {
+        [PAWN] = pst_pawn_eg, [KNIGHT] = pst_knight, [BISHOP] = pst_bishop,
+        [ROOK] = pst_rook, [QUEEN] = pst_queen, [KING] = pst_king_eg,
+    };
+
+    for (int type = PAWN; type <= KING; type++)
+    {
+        for (int sq = 0; sq < 64; sq++)
+        {
+            // The tables are drawn rank 8 first, so white's square is
+            // flipped vertically to find its entry, and black's is not.
+            int white_index = SQUARE(7 - RANK_OF(sq), FILE_OF(sq));
+            int black_index = sq;
+
+            psqt_mg[1][type][sq] = material_values[type] + mg_tables[type][white_index];
+            psqt_eg[1][type][sq] = material_values[type] + eg_tables[type][white_index];
+            psqt_mg[0][type][sq] = -(material_values[type] + mg_tables[type][black_index]);
+            psqt_eg[0][type][sq] = -(material_values[type] + eg_tables[type][black_index]);
+        }
+    }
+}
+
 int get_piece(const struct board *b, struct coord at)
 {
     return b->pieces[at.rank*8+at.file];
 }
 
+static void addToPieceList(struct board *b, int color_index, int sq)
+{
+    b->list_index[sq] = b->piece_count[color_index];
+    b->piece_list[color_index][b->piece_count[color_index]++] = sq;
+}
+
+static void removeFromPieceList(struct board *b, int color_index, int sq)
+{
+    // Move the last entry into the vacated slot
+    int last = b->piece_list[color_index][--b->piece_count[color_index]];
+    b->piece_list[color_index][b->list_index[sq]] = last;
+    b->list_index[last] = b->list_index[sq];
+}
+
+/*
+ * Switch the NNUE features for a square off for old_piece and on for piece.
+ * Kings are not features, but moving one changes all of its own side's
+ * features, so that side's accumulator is left to be rebuilt instead.
+ */
+static void updateAccumulator(struct board *b, int sq, int old_piece, int piece)
+{
+    for (int p = 0; p < 2; p++)
+    {
+        int king = KING | (p ? WHITE : BLACK);
+        if (old_piece == king || piece == king)
+        {
+            b->accumulator.dirty[p] = true;
+        }
+        if (b->accumulator.dirty[p]) { continue; }
+
+        int16_t *acc = b->accumulator.values[p];
+        if (old_piece != NONE && (old_piece & PIECE_TYPE) != KING)
+        {
+            nnueUpdateFeature(acc, nnueFeature(p, b->king_sq[p],
+                        COLOR_INDEX(old_piece), old_piece & PIECE_TYPE, sq), -1);
+        }
+        if (piece != NONE && (piece & PIECE_TYPE) != KING)
+        {
+            nnueUpdateFeature(acc, nnueFeature(p, b->king_sq[p],
+                        COLOR_INDEX(piece), piece & PIECE_TYPE, sq), 1);
+        }
+    }
+}
+
+void set_square(struct board *b, int sq, int piece)
+{
+    uint64_t mask = SQUARE_BB(sq);
+    int old_piece = b->pieces[sq];
+
+    bool same_color = (old_piece & PIECE_COLOR) == (piece & PIECE_COLOR);
+
+    if (nnue_net != NULL)
+    {
+        updateAccumulator(b, sq, old_piece, piece);
+    }
+    else
+    {
+        // A network loaded later must not trust these accumulators
+        b->accumulator.dirty[0] = b->accumulator.dirty[1] = true;
+    }
+
+    if (old_piece != NONE)
+    {
+        b->hash ^= zobristPiece(old_piece, sq);
+        b->mg_score -= psqt_mg[COLOR_INDEX(old_piece)][old_piece & PIECE_TYPE][sq];
+        b->eg_score -= psqt_eg[COLOR_INDEX(old_piece)][old_piece & PIECE_TYPE][sq];
+        b->phase -= phase_weights[old_piece & PIECE_TYPE];
+        b->bitboards[COLOR_INDEX(old_piece)][old_piece & PIECE_TYPE] &= ~mask;
+        b->bitboards[COLOR_INDEX(old_piece)][NONE] &= ~mask;
+        if (!same_color) { removeFromPieceList(b, COLOR_INDEX(old_piece), sq); }
+    }
+
+    if (piece != NONE)
+    {
+        b->hash ^= zobristPiece(piece, sq);
+        b->mg_score += psqt_mg[COLOR_INDEX(piece)][piece & PIECE_TYPE][sq];
+        b->eg_score += psqt_eg[COLOR_INDEX(piece)][piece & PIECE_TYPE][sq];
+        b->phase += phase_weights[piece & PIECE_TYPE];
+        b->bitboards[COLOR_INDEX(piece)][piece & PIECE_TYPE] |= mask;
+        b->bitboards[COLOR_INDEX(piece)][NONE] |= mask;
+        if (!same_color) { addToPieceList(b, COLOR_INDEX(piece), sq); }
+        if ((piece & PIECE_TYPE) == KING) { b->king_sq[COLOR_INDEX(piece)] = sq; }
+    }
+
+    b->pieces[sq] = piece;
+}
+
 void set_piece(struct board *b, struct coord at, int piece)
 {
-    b->pieces[at.rank*8 + at.file] = piece;
+    set_square(b, at.rank*8 + at.file, piece);
+}
+
+uint64_t occupied(const struct board *b)
+{
+    return b->bitboards[0][NONE] | b->bitboards[1][NONE];
+}
+
+/*
+ * The Zobrist key of a position, computed from scratch.
+ */
+uint64_t computeHash(const struct board *b)
+{
+    uint64_t hash = 0;
+
+    for (int sq = 0; sq < 64; sq++)
+    {
+        if (b->pieces[sq] != NONE)
+        {
+            hash ^= zobristPiece(b->pieces[sq], sq);
+        }
+    }
+
+    if (!b->white_to_move) { hash ^= zobrist_black_to_move; }
+    hash ^= zobrist_castles[b->castles_available];
+    hash ^= zobristEP(b->ep_target);
+
+    return hash;
 }
 
 void apply_FEN(struct board *b, const char *fen)
@@ -152,15 +514,54 @@ void apply_FEN(struct board *b, const char *fen)
                 break;
         }
     }
+
+    b->hash = computeHash(b);
+}
+
+/*
+ * Do two boards hold the same position? The piece lists may list the same
+ * squares in a different order, so they are not compared directly.
+ */
+bool boardsEqual(const struct board *b1, const struct board *b2)
+{
+    return memcmp(b1->pieces, b2->pieces, sizeof(b1->pieces)) == 0
+        && memcmp(b1->bitboards, b2->bitboards, sizeof(b1->bitboards)) == 0
+        && b1->piece_count[0] == b2->piece_count[0]
+        && b1->piece_count[1] == b2->piece_count[1]
+        && b1->king_sq[0] == b2->king_sq[0]
+        && b1->king_sq[1] == b2->king_sq[1]
+        && b1->white_to_move == b2->white_to_move
+        && b1->castles_available == b2->castles_available
+        && b1->ep_target.rank == b2->ep_target.rank
+        && b1->ep_target.file == b2->ep_target.file
+        && b1->hash == b2->hash
+        && b1->mg_score == b2->mg_score
+        && b1->eg_score == b2->eg_score
+        && b1->phase == b2->phase;
 }
 
 void init_board(struct board *b)
 {
+    initAttackTables();
+    initZobrist();
+    initPSQT();
+
     memset(b->pieces, 0, sizeof(b->pieces));
+    memset(b->bitboards, 0, sizeof(b->bitboards));
+    b->piece_count[0] = 0;
+    b->piece_count[1] = 0;
+    b->king_sq[0] = -1;
+    b->king_sq[1] = -1;
     b->white_to_move = true;
     b->castles_available = 0;
     b->ep_target.rank = -1;
     b->ep_target.file = -1;
+    b->hash = computeHash(b);
+    b->mg_score = 0;
+    b->eg_score = 0;
+    b->phase = 0;
+    b->accumulator.dirty[0] = true;
+    b->accumulator.dirty[1] = true;
 }
 
 
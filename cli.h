@@ -109,16 +109,16 @@ void printBoard(const struct board *b, const struct moveList *ml)
             {
                 for (int i = 0; i < ml->n_moves; i++)
                 {
-                    const struct coord *movefrom = &(ml->moves[i].from);
-                    const struct coord *moveto = &(ml->moves[i].to);
+                    struct coord movefrom = moveFromCoord(ml->moves[i]);
+                    struct coord moveto = moveToCoord(ml->moves[i]);
 
-                    if (movefrom->rank == rank && movefrom->file == file)
+                    if (movefrom.rank == rank && movefrom.file == file)
                     {
                         selected = true;
                         break;
                     }
 
-                    if (moveto->rank == rank && moveto->file == file)
+                    if (moveto.rank == rank && moveto.file == file)
                     {
                         can_move_to = true;
                         break;
@@ -344,18 +344,20 @@ bool moveAlgebraic(struct board *b, const char *move, struct moveList *allLegalM
 
     for (int i_move = 0; i_move < allLegalMoves->n_moves; i_move++)
     {
-        struct move *m = &(allLegalMoves->moves[i_move]);
+        struct move m = allLegalMoves->moves[i_move];
+        struct coord from = moveFromCoord(m);
+        struct coord to = moveToCoord(m);
 
-        if (m->to.rank != rank_to) { continue; }
-        if (m->to.file != file_to) { continue; }
+        if (to.rank != rank_to) { continue; }
+        if (to.file != file_to) { continue; }
 
-        if (m->promotion != promotion) { continue; }
+        if (movePromotion(m) != promotion) { continue; }
 
-        if (get_piece(b, m->from) != piece) { continue; }
+        if (get_piece(b, from) != piece) { continue; }
 
         // We only check the departure rank/file if they were actually set
-        if (rank_from >= 0 && m->from.rank != rank_from) { continue; }
-        if (file_from >= 0 && m->from.file != file_from) { continue; }
+        if (rank_from >= 0 && from.rank != rank_from) { continue; }
+        if (file_from >= 0 && from.file != file_from) { continue; }
 
         i_match = i_move;
         n_matching_moves++;
@@ -386,11 +388,12 @@ const char *getPieceTypeStr(int piece)
 
 void printMove(struct board *b, struct move m)
 {
-    int piece = get_piece(b, m.from);
+    int piece = get_piece(b, moveFromCoord(m));
+    struct coord to = moveToCoord(m);
     const char *owner = ((piece & PIECE_COLOR) == WHITE) ? "White" : "Black";
     const char *type = getPieceTypeStr(piece);
 
-    printf("%s's move: %s to %c%c\n", owner, type, m.to.file + 'a', m.to.rank + '1');
+    printf("%s's move: %s to %c%c\n", owner, type, to.file + 'a', to.rank + '1');
 }
 
 #endif // CLI_H
@@ -0,0 +1,66 @@
+#ifndef EVAL_H
+#define EVAL_H
+
+#include "board.h"
+
+// Blend a middlegame and an endgame score by how much material is left.
+static inline int taperedScore(int mg_score, int eg_score, int phase)
+{
+    phase = MIN(phase, PHASE_MAX);
+    return (mg_score * phase + eg_score * (PHASE_MAX - phase)) / PHASE_MAX;
+}
+
+// Rebuild one side's NNUE accumulator from scratch.
+void refreshAccumulator(struct board *b, int perspective)
+{
+    int16_t *acc = b->accumulator.values[perspective];
+    nnueResetAccumulator(acc);
+
+    for (int c = 0; c < 2; c++)
+    {
+        for (int i = 0; i < b->piece_count[c]; i++)
+        {
+            int sq = b->piece_list[c][i];
+            int type = b->pieces[sq] & PIECE_TYPE;
+            if (type != KING)
+            {
+                nnueUpdateFeature(acc, nnueFeature(perspective, b->king_sq[perspective], c, type, sq), 1);
+            }
+        }
+    }
+    b->accumulator.dirty[perspective] = false;
+}
+
+/*
+ * The NNUE evaluation, from the point of view of the side to move.
+ * Accumulators left out of date by a king move are rebuilt first.
+ */
+int evaluateNNUE(struct board *b)
+{
+    for (int p = 0; p < 2; p++)
+    {
+        if (b->accumulator.dirty[p]) { refreshAccumulator(b, p); }
+    }
+
+    int us = b->white_to_move ? 1 : 0;
+    return nnueOutput(b->accumulator.values[us], b->accumulator.values[!us]);
+}
+
+/*
+ * The static evaluation, from the point of view of the side to move. With
+ * a network loaded (see nnueLoad), that network's score. Otherwise, the
+ * board's material and piece-square scores, blended between middlegame
+ * and endgame by how much material is left.
+ */
+int evaluate(struct board *b)
+{
+    if (nnue_net != NULL)
+    {
+        return evaluateNNUE(b);
+    }
+
+    int score = taperedScore(b->mg_score, b->eg_score, b->phase);
+    return b->white_to_move ? score : -score;
+}
+
+#endif // EVAL_H
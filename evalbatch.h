@@ -0,0 +1,388 @@
+#ifndef EVALBATCH_H
+#define EVALBATCH_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BATCH_X86
+#include <immintrin.h>
+#endif
+
+#include "board.h"
+#include "eval.h"
+
+/*
+ * Evaluating many positions at once, for offline work (tuning, training
+ * data, EPD sweeps). The positions are stored as a structure of arrays:
+ * for each square, one byte per position saying what stands there. The
+ * evaluation then walks the squares, and for each one looks up the scores
+ * of a whole vector of positions at a time, using byte shuffles as
+ * 16-entry table lookups. The result is the same as evaluate() gives,
+ * to the bit.
+ *
+ * On x86, the vector kernels are always compiled, each for its own
+ * instruction set, and the fastest one the CPU supports is picked when
+ * the batch is evaluated: AVX2 handles 32 positions per step, SSSE3
+ * handles 16, and anything else uses the scalar code. A default build
+ * thus still uses them, and evalbench can time each one.
+ */
+
+// A batch's capacity is rounded up to a multiple of this, so that the
+// vector kernels never need a scalar tail.
+#define BATCH_ALIGN 32
+
+struct positionBatch
+{
+    int n_positions;
+    int capacity;
+
+    // pieces[sq * capacity + i] is the piece code on sq in position i:
+    // 0 for empty, 1-6 for white PAWN..KING, 7-12 for black.
+    uint8_t *pieces;
+    uint8_t *white_to_move;
+};
+
+static inline int batchPieceCode(int piece)
+{
+    if (piece == NONE) { return 0; }
+    return (piece & PIECE_TYPE) + ((piece & PIECE_COLOR) == BLACK ? 6 : 0);
+}
+
+/*
+ * The piece-square tables rearranged for the vector kernels: for each
+ * square, the 16-bit middlegame and endgame scores of each piece code,
+ * split into a table of low bytes and one of high bytes, and the phase
+ * weight of each code.
+ */
+uint8_t batch_mg_lo[64][16], batch_mg_hi[64][16];
+uint8_t batch_eg_lo[64][16], batch_eg_hi[64][16];
+uint8_t batch_phase[64][16];
+
+void initBatchTables()
+{
+    static bool initialized = false;
+    if (initialized) { return; }
+    initialized = true;
+
+    initPSQT();
+    for (int sq = 0; sq < 64; sq++)
+    {
+        for (int code = 1; code <= 12; code++)
+        {
+            int c = (code > 6) ? 0 : 1;
+            int type = (code > 6) ? code - 6 : code;
+
+            uint16_t mg = (uint16_t) psqt_mg[c][type][sq];
+            uint16_t eg = (uint16_t) psqt_eg[c][type][sq];
+            batch_mg_lo[sq][code] = mg & 0xff;
+            batch_mg_hi[sq][code] = mg >> 8;
+            batch_eg_lo[sq][code] = eg & 0xff;
+            batch_eg_hi[sq][code] = eg >> 8;
+            batch_phase[sq][code] = phase_weights[type];
+        }
+    }
+}
+
+void initBatch(struct positionBatch *batch, int capacity)
+{
+    initBatchTables();
+    capacity = (capacity + BATCH_ALIGN - 1) / BATCH_ALIGN * BATCH_ALIGN;
+    batch->n_positions = 0;
+    batch->capacity = capacity;
+    batch->pieces = calloc((size_t) 64 * capacity, 1);
+    batch->white_to_move = calloc(capacity, 1);
+}
+
+void freeBatch(struct positionBatch *batch)
+{
+    free(batch->pieces);
+    free(batch->white_to_move);
+    batch->pieces = NULL;
+    batch->white_to_move = NULL;
+}
+
+// Append a position. Returns its index, or -1 if the batch is full.
+int addToBatch(struct positionBatch *batch, const struct board *b)
+{
+    if (batch->n_positions == batch->capacity) { return -1; }
+
+    int i = batch->n_positions++;
+    for (int sq = 0; sq < 64; sq++)
+    {
+        batch->pieces[(size_t) sq * batch->capacity + i] = batchPieceCode(b->pieces[sq]);
+    }
+    batch->white_to_move[i] = b->white_to_move;
+    return i;
+}
+
+// Finish off one position from its summed scores, exactly as evaluate() does.
+static inline int finishScore(const struct positionBatch *batch, int i, int mg, int eg, int phase)
+{
+    int score = taperedScore(mg, eg, phase);
+    return batch->white_to_move[i] ? score : -score;
+}
+
+void evaluateBatchScalar(const struct positionBatch *batch, int *scores)
+{
+    // Walk the squares in the outer loop, as the vector kernels do, so
+    // that each square's row of pieces is read in order.
+    int n = batch->n_positions;
+    int *sums = calloc((size_t) 3 * n, sizeof(int));
+    int *mg = sums, *eg = sums + n, *phase = sums + 2 * n;
+
+    for (int sq = 0; sq < 64; sq++)
+    {
+        const uint8_t *row = &batch->pieces[(size_t) sq * batch->capacity];
+        for (int i = 0; i < n; i++)
+        {
+            int code = row[i];
+            if (code == 0) { continue; }
+
+            int c = (code > 6) ? 0 : 1;
+            int type = (code > 6) ? code - 6 : code;
+            mg[i] += psqt_mg[c][type][sq];
+            eg[i] += psqt_eg[c][type][sq];
+            phase[i] += phase_weights[type];
+        }
+    }
+
+    for (int i = 0; i < n; i++)
+    {
+        scores[i] = finishScore(batch, i, mg[i], eg[i], phase[i]);
+    }
+    free(sums);
+}
+
+/*
+ * The vector kernels add up 16-bit scores, widening them to 32 bits every
+ * 8 squares. No table entry is beyond +-2048, so the 16-bit sums cannot
+ * overflow, whatever the positions hold.
+ */
+#define BATCH_WIDEN_EVERY 8
+
+#ifdef BATCH_X86
+
+// Compile a function for the instruction set, whatever the build flags.
+#define BATCH_AVX2 __attribute__((target("avx2")))
+#define BATCH_SSSE3 __attribute__((target("ssse3")))
+
+
+// Look up a 16-bit value for each of 32 codes, as two vectors of 16.
+BATCH_AVX2 static inline void lookup16x32(const uint8_t *lo_table, const uint8_t *hi_table,
+        __m256i codes, __m256i *a, __m256i *b)
+{
+    __m256i lo = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) lo_table)), codes);
+    __m256i hi = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) hi_table)), codes);
+    *a = _mm256_unpacklo_epi8(lo, hi);
+    *b = _mm256_unpackhi_epi8(lo, hi);
+}
+
+// Sign-extend 16-bit lanes into two vectors of 32-bit lanes and add them on.
+BATCH_AVX2 static inline void widenAdd256(__m256i v, __m256i *acc0, __m256i *acc1)
+{
+    *acc0 = _mm256_add_epi32(*acc0, _mm256_srai_epi32(_mm256_unpacklo_epi16(v, v), 16));
+    *acc1 = _mm256_add_epi32(*acc1, _mm256_srai_epi32(_mm256_unpackhi_epi16(v, v), 16));
+}
+
+/*
+ * The unpacks work within 128-bit lanes, so the 32-bit sums come out in
+ * the order 0-3,16-19 / 4-7,20-23 / 8-11,24-27 / 12-15,28-31; this puts
+ * them back in position order.
+ */
+BATCH_AVX2 static inline void storeInOrder(int32_t *out, const __m256i acc[4])
+{
+    _mm256_storeu_si256((__m256i *) (out + 0), _mm256_permute2x128_si256(acc[0], acc[1], 0x20));
+    _mm256_storeu_si256((__m256i *) (out + 8), _mm256_permute2x128_si256(acc[2], acc[3], 0x20));
+    _mm256_storeu_si256((__m256i *) (out + 16), _mm256_permute2x128_si256(acc[0], acc[1], 0x31));
+    _mm256_storeu_si256((__m256i *) (out + 24), _mm256_permute2x128_si256(acc[2], acc[3], 0x31));
+}
+
+BATCH_AVX2 void evaluateBatchAVX2(const struct positionBatch *batch, int *scores)
+{
+    for (int i = 0; i < batch->n_positions; i += 32)
+    {
+        __m256i mg[4], eg[4], phase[4];
+        for (int k = 0; k < 4; k++)
+        {
+            mg[k] = eg[k] = phase[k] = _mm256_setzero_si256();
+        }
+
+        for (int group = 0; group < 64; group += BATCH_WIDEN_EVERY)
+        {
+            __m256i mg16[2] = { _mm256_setzero_si256(), _mm256_setzero_si256() };
+            __m256i eg16[2] = { _mm256_setzero_si256(), _mm256_setzero_si256() };
+            __m256i phase16[2] = { _mm256_setzero_si256(), _mm256_setzero_si256() };
+
+            for (int sq = group; sq < group + BATCH_WIDEN_EVERY; sq++)
+            {
+                __m256i codes = _mm256_loadu_si256((const __m256i *) &batch->pieces[(size_t) sq * batch->capacity + i]);
+                __m256i a, b;
+
+                lookup16x32(batch_mg_lo[sq], batch_mg_hi[sq], codes, &a, &b);
+                mg16[0] = _mm256_add_epi16(mg16[0], a);
+                mg16[1] = _mm256_add_epi16(mg16[1], b);
+
+                lookup16x32(batch_eg_lo[sq], batch_eg_hi[sq], codes, &a, &b);
+                eg16[0] = _mm256_add_epi16(eg16[0], a);
+                eg16[1] = _mm256_add_epi16(eg16[1], b);
+
+                __m256i ph = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) batch_phase[sq])), codes);
+                phase16[0] = _mm256_add_epi16(phase16[0], _mm256_unpacklo_epi8(ph, _mm256_setzero_si256()));
+                phase16[1] = _mm256_add_epi16(phase16[1], _mm256_unpackhi_epi8(ph, _mm256_setzero_si256()));
+            }
+
+            widenAdd256(mg16[0], &mg[0], &mg[1]);
+            widenAdd256(mg16[1], &mg[2], &mg[3]);
+            widenAdd256(eg16[0], &eg[0], &eg[1]);
+            widenAdd256(eg16[1], &eg[2], &eg[3]);
+            widenAdd256(phase16[0], &phase[0], &phase[1]);
+            widenAdd256(phase16[1], &phase[2], &phase[3]);
+        }
+
+        int32_t mg_out[32], eg_out[32], phase_out[32];
+        storeInOrder(mg_out, mg);
+        storeInOrder(eg_out, eg);
+        storeInOrder(phase_out, phase);
+
+        int n = MIN(32, batch->n_positions - i);
+        for (int j = 0; j < n; j++)
+        {
+            scores[i + j] = finishScore(batch, i + j, mg_out[j], eg_out[j], phase_out[j]);
+        }
+    }
+}
+
+
+// Look up a 16-bit value for each of 16 codes, as two vectors of 8.
+BATCH_SSSE3 static inline void lookup16x16(const uint8_t *lo_table, const uint8_t *hi_table,
+        __m128i codes, __m128i *a, __m128i *b)
+{
+    __m128i lo = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) lo_table), codes);
+    __m128i hi = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) hi_table), codes);
+    *a = _mm_unpacklo_epi8(lo, hi);
+    *b = _mm_unpackhi_epi8(lo, hi);
+}
+
+// Sign-extend 16-bit lanes into two vectors of 32-bit lanes and add them on.
+BATCH_SSSE3 static inline void widenAdd128(__m128i v, __m128i *acc0, __m128i *acc1)
+{
+    *acc0 = _mm_add_epi32(*acc0, _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+    *acc1 = _mm_add_epi32(*acc1, _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16));
+}
+
+BATCH_SSSE3 void evaluateBatchSSSE3(const struct positionBatch *batch, int *scores)
+{
+    for (int i = 0; i < batch->n_positions; i += 16)
+    {
+        // Sums for positions 0-3, 4-7, 8-11 and 12-15
+        __m128i mg[4], eg[4], phase[4];
+        for (int k = 0; k < 4; k++)
+        {
+            mg[k] = eg[k] = phase[k] = _mm_setzero_si128();
+        }
+
+        for (int group = 0; group < 64; group += BATCH_WIDEN_EVERY)
+        {
+            __m128i mg16[2] = { _mm_setzero_si128(), _mm_setzero_si128() };
+            __m128i eg16[2] = { _mm_setzero_si128(), _mm_setzero_si128() };
+            __m128i phase16[2] = { _mm_setzero_si128(), _mm_setzero_si128() };
+
+            for (int sq = group; sq < group + BATCH_WIDEN_EVERY; sq++)
+            {
+                __m128i codes = _mm_loadu_si128((const __m128i *) &batch->pieces[(size_t) sq * batch->capacity + i]);
+                __m128i a, b;
+
+                lookup16x16(batch_mg_lo[sq], batch_mg_hi[sq], codes, &a, &b);
+                mg16[0] = _mm_add_epi16(mg16[0], a);
+                mg16[1] = _mm_add_epi16(mg16[1], b);
+
+                lookup16x16(batch_eg_lo[sq], batch_eg_hi[sq], codes, &a, &b);
+                eg16[0] = _mm_add_epi16(eg16[0], a);
+                eg16[1] = _mm_add_epi16(eg16[1], b);
+
+                __m128i ph = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) batch_phase[sq]), codes);
+                phase16[0] = _mm_add_epi16(phase16[0], _mm_unpacklo_epi8(ph, _mm_setzero_si128()));
+                phase16[1] = _mm_add_epi16(phase16[1], _mm_unpackhi_epi8(ph, _mm_setzero_si128()));
+            }
+
+            widenAdd128(mg16[0], &mg[0], &mg[1]);
+            widenAdd128(mg16[1], &mg[2], &mg[3]);
+            widenAdd128(eg16[0], &eg[0], &eg[1]);
+            widenAdd128(eg16[1], &eg[2], &eg[3]);
+            widenAdd128(phase16[0], &phase[0], &phase[1]);
+            widenAdd128(phase16[1], &phase[2], &phase[3]);
+        }
+
+        int32_t mg_out[16], eg_out[16], phase_out[16];
+        for (int k = 0; k < 4; k++)
+        {
+            _mm_storeu_si128((__m128i *) (mg_out + 4 * k), mg[k]);
+            _mm_storeu_si128((__m128i *) (eg_out + 4 * k), eg[k]);
+            _mm_storeu_si128((__m128i *) (phase_out + 4 * k), phase[k]);
+        }
+
+        int n = MIN(16, batch->n_positions - i);
+        for (int j = 0; j < n; j++)
+        {
+            scores[i + j] = finishScore(batch, i + j, mg_out[j], eg_out[j], phase_out[j]);
+        }
+    }
+}
+
+bool cpuHasAVX2()
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+bool cpuHasSSSE3()
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("ssse3");
+}
+
+#endif
+
+struct batchKernel
+{
+    const char *name;
+    void (*evaluate)(const struct positionBatch *batch, int *scores);
+    // NULL if every CPU can run it
+    bool (*supported)();
+};
+
+// Fastest first; the scalar kernel comes last and always runs.
+const struct batchKernel batch_kernels[] = {
+#ifdef BATCH_X86
+    { "AVX2", evaluateBatchAVX2, cpuHasAVX2 },
+    { "SSSE3", evaluateBatchSSSE3, cpuHasSSSE3 },
+#endif
+    { "scalar", evaluateBatchScalar, NULL },
+};
+
+#define N_BATCH_KERNELS ((int) (sizeof(batch_kernels) / sizeof(batch_kernels[0])))
+
+static inline bool batchKernelSupported(const struct batchKernel *kernel)
+{
+    return kernel->supported == NULL || kernel->supported();
+}
+
+// The kernel evaluateBatch() uses on this CPU.
+const struct batchKernel *bestBatchKernel()
+{
+    const struct batchKernel *kernel = batch_kernels;
+    while (!batchKernelSupported(kernel)) { kernel++; }
+    return kernel;
+}
+
+/*
+ * Evaluate every position in the batch, from the point of view of its side
+ * to move, writing the scores to scores[0..n_positions-1].
+ */
+void evaluateBatch(const struct positionBatch *batch, int *scores)
+{
+    bestBatchKernel()->evaluate(batch, scores);
+}
+
+#endif // EVALBATCH_H
@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "board.h"
+#include "moves.h"
+#include "eval.h"
+#include "evalbatch.h"
+#include "timeman.h"
+
+/*
+ * Throughput benchmark for batch evaluation. Fills a batch with positions
+ * from random games (always the same ones), checks that every kernel this
+ * CPU supports agrees with evaluate() on every position, then times each
+ * one against the scalar kernel.
+ *
+ * Usage: ./evalbench [positions] [rounds]
+ */
+
+#define DEFAULT_POSITIONS 65536
+#define DEFAULT_ROUNDS 50
+#define MAX_GAME_PLIES 120
+
+// Play random games from the start position, adding every position reached.
+void fillBatch(struct positionBatch *batch, int *expected, int n_positions)
+{
+    uint64_t seed = 0x9e3779b97f4a7c15ULL;
+    struct board b;
+
+    while (batch->n_positions < n_positions)
+    {
+        init_board(&b);
+        apply_FEN(&b, "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+
+        for (int ply = 0; ply < MAX_GAME_PLIES && batch->n_positions < n_positions; ply++)
+        {
+            struct moveList ml;
+            init_movelist(&ml);
+            genAllMoves(&b, &ml);
+            if (ml.n_moves == 0) { break; }
+
+            applyMove(&b, ml.moves[random64(&seed) % ml.n_moves]);
+
+            int i = addToBatch(batch, &b);
+            expected[i] = evaluate(&b);
+        }
+    }
+}
+
+bool checkScores(const char *name, const int *scores, const int *expected, int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        if (scores[i] != expected[i])
+        {
+            printf("%s kernel: position %d scored %d, evaluate() gives %d\n",
+                    name, i, scores[i], expected[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+double timeKernel(void (*kernel)(const struct positionBatch *, int *),
+        const struct positionBatch *batch, int *scores, int rounds)
+{
+    double start = monotonicSeconds();
+    for (int r = 0; r < rounds; r++)
+    {
+        kernel(batch, scores);
+    }
+    return monotonicSeconds() - start;
+}
+
+int main(int argc, char **argv)
+{
+    int n_positions = (argc > 1) ? atoi(argv[1]) : DEFAULT_POSITIONS;
+    int rounds = (argc > 2) ? atoi(argv[2]) : DEFAULT_ROUNDS;
+
+    struct positionBatch batch;
+    initBatch(&batch, n_positions);
+    int *expected = malloc(sizeof(int) * batch.capacity);
+    int *scores = malloc(sizeof(int) * batch.capacity);
+
+    fillBatch(&batch, expected, n_positions);
+
+    bool ok = true;
+    for (int k = 0; k < N_BATCH_KERNELS; k++)
+    {
+        if (!batchKernelSupported(&batch_kernels[k])) { continue; }
+        batch_kernels[k].evaluate(&batch, scores);
+        ok = checkScores(batch_kernels[k].name, scores, expected, n_positions) && ok;
+    }
+    if (!ok) { return 1; }
+
+    double scalar_time = timeKernel(evaluateBatchScalar, &batch, scores, rounds);
+    double total = (double) n_positions * rounds;
+
+    printf("%d positions x %d rounds, all scores match evaluate()\n", n_positions, rounds);
+    for (int k = 0; k < N_BATCH_KERNELS; k++)
+    {
+        const struct batchKernel *kernel = &batch_kernels[k];
+        if (!batchKernelSupported(kernel))
+        {
+            printf("%s: not supported by this CPU\n", kernel->name);
+            continue;
+        }
+        double seconds = (kernel->evaluate == evaluateBatchScalar)
+            ? scalar_time : timeKernel(kernel->evaluate, &batch, scores, rounds);
+        printf("%s: %.1f M positions/s (%.1fx)\n", kernel->name,
+                total / seconds / 1e6, scalar_time / seconds);
+    }
+
+    freeBatch(&batch);
+    free(expected);
+    free(scores);
+    return 0;
+}
@@ -22,11 +22,33 @@ bool select_piece(const char *coord_str, struct board *b, struct moveList *ml)
     genMovesForPiece(b, (struct coord) {rank, file}, ml);
 }
 
-int main(void)
+/*
+ * After each iteration of the AI's search, print where its nodes went:
+ * readably on stdout, and as a line of JSON on stderr for scripts
+ * (e.g. `./chest 2>search.jsonl`).
+ */
+void printIteration(const struct searchReport *report)
+{
+    printStats(stdout, report->stats);
+    printStatsJSON(stderr, report->stats);
+}
+
+int main(int argc, char **argv)
 {
     struct board b;
     init_board(&b);
     initComputer();
+    report_iteration = printIteration;
+
+    // Optional argument: the number of threads the AI searches with
+    if (argc > 1) { setThreads(atoi(argv[1])); }
+
+    // Optional second argument: an NNUE network file to evaluate with
+    if (argc > 2 && !nnueLoad(argv[2]))
+    {
+        printf("Could not load network %s\n", argv[2]);
+        return 1;
+    }
 
     // default position
     apply_FEN(&b, "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
@@ -96,7 +118,6 @@ int main(void)
         {
             printf("%s is thinking...\n", mover_str);
             struct move m = getComputerMove(&b);
-            printf("(Evaluated %d positions.)\n", eval_counter);
             printMove(&b, m);
             applyMove(&b, m);
         }
@@ -0,0 +1,387 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "board.h"
+#include "moves.h"
+#include "eval.h"
+#include "timeman.h"
+
+/*
+ * Times the board primitives one at a time over a corpus of positions from
+ * random games, so that a slowdown can be pinned on the function that
+ * caused it rather than on perft or search as a whole.
+ *
+ * Each benchmark is warmed up, then timed over a number of samples; each
+ * sample is one or more passes over the whole corpus. The median sample is
+ * reported, along with the mean of the samples left after dropping
+ * outliers (Tukey's fences: beyond 1.5 interquartile ranges).
+ *
+ * With --perf, also counts CPU cycles and instructions per call through
+ * perf_event_open, where the kernel allows it.
+ *
+ * Usage: ./microbench [--csv] [--perf] [samples]
+ */
+
+#define CORPUS_SIZE 1000
+#define CORPUS_GAME_PLIES 80
+#define DEFAULT_SAMPLES 30
+#define WARMUP_PASSES 3
+
+// Each sample runs enough passes to take at least this long, so that the
+// clock's resolution does not matter.
+#define MIN_SAMPLE_SECONDS 0.01
+
+struct corpus
+{
+    int n_positions;
+    struct board *positions;
+    struct moveList *legal;
+    struct moveList *pseudo_legal;
+};
+
+// Results are added into this so that the compiler cannot drop the calls.
+volatile long long int sink;
+
+// Positions from random games (always the same ones), skipping the start
+// position and positions with no legal moves.
+void buildCorpus(struct corpus *c, int n_positions)
+{
+    c->n_positions = 0;
+    c->positions = aligned_alloc(_Alignof(struct board), sizeof(struct board) * n_positions);
+    c->legal = malloc(sizeof(struct moveList) * n_positions);
+    c->pseudo_legal = malloc(sizeof(struct moveList) * n_positions);
+
+    uint64_t seed = 0x9e3779b97f4a7c15ULL;
+    struct board b;
+
+    while (c->n_positions < n_positions)
+    {
+        init_board(&b);
+        apply_FEN(&b, "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+
+        for (int ply = 0; ply < CORPUS_GAME_PLIES && c->n_positions < n_positions; ply++)
+        {
+            struct moveList ml;
+            init_movelist(&ml);
+            genAllMoves(&b, &ml);
+            if (ml.n_moves == 0) { break; }
+            applyMove(&b, ml.moves[random64(&seed) % ml.n_moves]);
+
+            int i = c->n_positions;
+            init_movelist(&c->legal[i]);
+            genAllMoves(&b, &c->legal[i]);
+            if (c->legal[i].n_moves == 0) { break; }
+            init_movelist(&c->pseudo_legal[i]);
+            genAllPseudoLegalMoves(&b, &c->pseudo_legal[i]);
+            c->positions[i] = b;
+            c->n_positions++;
+        }
+    }
+}
+
+void freeCorpus(struct corpus *c)
+{
+    free(c->positions);
+    free(c->legal);
+    free(c->pseudo_legal);
+}
+
+// One pass of each benchmark over the corpus. Each returns its number of calls.
+
+long long int benchGenAllMoves(struct corpus *c)
+{
+    long long int sum = 0;
+    for (int i = 0; i < c->n_positions; i++)
+    {
+        struct moveList ml;
+        init_movelist(&ml);
+        genAllMoves(&c->positions[i], &ml);
+        sum += ml.n_moves;
+    }
+    sink += sum;
+    return c->n_positions;
+}
+
+long long int benchGenAllPseudoLegalMoves(struct corpus *c)
+{
+    long long int sum = 0;
+    for (int i = 0; i < c->n_positions; i++)
+    {
+        struct moveList ml;
+        init_movelist(&ml);
+        genAllPseudoLegalMoves(&c->positions[i], &ml);
+        sum += ml.n_moves;
+    }
+    sink += sum;
+    return c->n_positions;
+}
+
+// applyMove cannot run twice on the same board without an undo, so each
+// call is an applyMove and its undoMove.
+long long int benchApplyMove(struct corpus *c)
+{
+    long long int calls = 0;
+    uint64_t sum = 0;
+    for (int i = 0; i < c->n_positions; i++)
+    {
+        struct board *b = &c->positions[i];
+        const struct moveList *ml = &c->legal[i];
+        for (int j = 0; j < ml->n_moves; j++)
+        {
+            struct undo u = applyMove(b, ml->moves[j]);
+            sum += b->hash;
+            undoMove(b, ml->moves[j], u);
+        }
+        calls += ml->n_moves;
+    }
+    sink += sum;
+    return calls;
+}
+
+long long int benchIsKingInCheck(struct corpus *c)
+{
+    long long int sum = 0;
+    for (int i = 0; i < c->n_positions; i++)
+    {
+        sum += isKingInCheck(&c->positions[i]);
+    }
+    sink += sum;
+    return c->n_positions;
+}
+
+// Every pseudo-legal move, so that both answers are exercised.
+long long int benchIsMoveLegal(struct corpus *c)
+{
+    long long int calls = 0;
+    long long int sum = 0;
+    for (int i = 0; i < c->n_positions; i++)
+    {
+        const struct moveList *ml = &c->pseudo_legal[i];
+        for (int j = 0; j < ml->n_moves; j++)
+        {
+            sum += isMoveLegal(&c->positions[i], ml->moves[j]);
+        }
+        calls += ml->n_moves;
+    }
+    sink += sum;
+    return calls;
+}
+
+long long int benchEvaluate(struct corpus *c)
+{
+    long long int sum = 0;
+    for (int i = 0; i < c->n_positions; i++)
+    {
+        sum += evaluate(&c->positions[i]);
+    }
+    sink += sum;
+    return c->n_positions;
+}
+
+struct microBenchmark
+{
+    const char *name;
+    long long int (*pass)(struct corpus *c);
+};
+
+const struct microBenchmark benchmarks[] = {
+    { "genAllMoves", benchGenAllMoves },
+    { "genAllPseudoLegalMoves", benchGenAllPseudoLegalMoves },
+    { "applyMove+undoMove", benchApplyMove },
+    { "isKingInCheck", benchIsKingInCheck },
+    { "isMoveLegal", benchIsMoveLegal },
+    { "evaluate", benchEvaluate },
+};
+
+/*
+ * Hardware counters for this thread, user space only. A counter that could
+ * not be opened (no permission, or not on this machine) has fd -1.
+ */
+struct perfCounters
+{
+    int cycles_fd;
+    int instructions_fd;
+};
+
+int openCounter(uint64_t config)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+bool openPerfCounters(struct perfCounters *pc)
+{
+    pc->cycles_fd = openCounter(PERF_COUNT_HW_CPU_CYCLES);
+    pc->instructions_fd = openCounter(PERF_COUNT_HW_INSTRUCTIONS);
+    return pc->cycles_fd >= 0 || pc->instructions_fd >= 0;
+}
+
+void startCounters(const struct perfCounters *pc)
+{
+    int fds[2] = { pc->cycles_fd, pc->instructions_fd };
+    for (int i = 0; i < 2; i++)
+    {
+        if (fds[i] < 0) { continue; }
+        ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+        ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+// Stop a counter and return its count, or -1 if it is not open.
+long long int stopCounter(int fd)
+{
+    long long int count;
+    if (fd < 0) { return -1; }
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    if (read(fd, &count, sizeof(count)) != sizeof(count)) { return -1; }
+    return count;
+}
+
+struct result
+{
+    long long int calls;     // per sample
+    double median_ns;        // per call
+    double mean_ns;          // per call, without outliers
+    int n_outliers;
+    double cycles;           // per call, or -1 if not counted
+    double instructions;
+};
+
+int compareDoubles(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+struct result runBenchmark(const struct microBenchmark *bm, struct corpus *c,
+        int n_samples, const struct perfCounters *pc)
+{
+    struct result r = { 0 };
+
+    // Warm up the caches and branch predictors, and find how many passes
+    // make a long enough sample.
+    double start = monotonicSeconds();
+    for (int i = 0; i < WARMUP_PASSES; i++) { bm->pass(c); }
+    double pass_seconds = (monotonicSeconds() - start) / WARMUP_PASSES;
+    int passes = MAX(1, (int) (MIN_SAMPLE_SECONDS / MAX(pass_seconds, 1e-9)) + 1);
+
+    double *samples = malloc(sizeof(double) * n_samples);
+    if (pc != NULL) { startCounters(pc); }
+
+    for (int s = 0; s < n_samples; s++)
+    {
+        long long int calls = 0;
+        start = monotonicSeconds();
+        for (int p = 0; p < passes; p++) { calls += bm->pass(c); }
+        samples[s] = (monotonicSeconds() - start) * 1e9 / calls;
+        r.calls = calls;
+    }
+
+    long long int total_calls = r.calls * n_samples;
+    r.cycles = r.instructions = -1;
+    if (pc != NULL)
+    {
+        long long int cycles = stopCounter(pc->cycles_fd);
+        long long int instructions = stopCounter(pc->instructions_fd);
+        if (cycles >= 0) { r.cycles = (double) cycles / total_calls; }
+        if (instructions >= 0) { r.instructions = (double) instructions / total_calls; }
+    }
+
+    qsort(samples, n_samples, sizeof(double), compareDoubles);
+    r.median_ns = (n_samples % 2) ? samples[n_samples / 2]
+        : (samples[n_samples / 2 - 1] + samples[n_samples / 2]) / 2;
+
+    double q1 = samples[n_samples / 4];
+    double q3 = samples[(3 * n_samples) / 4];
+    double low = q1 - 1.5 * (q3 - q1);
+    double high = q3 + 1.5 * (q3 - q1);
+    double sum = 0;
+    int n_kept = 0;
+    for (int s = 0; s < n_samples; s++)
+    {
+        if (samples[s] < low || samples[s] > high) { continue; }
+        sum += samples[s];
+        n_kept++;
+    }
+    r.mean_ns = sum / n_kept;
+    r.n_outliers = n_samples - n_kept;
+
+    free(samples);
+    return r;
+}
+
+int main(int argc, char **argv)
+{
+    bool csv = false;
+    bool perf = false;
+    int n_samples = DEFAULT_SAMPLES;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--csv") == 0) { csv = true; }
+        else if (strcmp(argv[i], "--perf") == 0) { perf = true; }
+        else { n_samples = MAX(atoi(argv[i]), 1); }
+    }
+
+    struct perfCounters counters;
+    struct perfCounters *pc = NULL;
+    if (perf)
+    {
+        if (openPerfCounters(&counters)) { pc = &counters; }
+        else { fprintf(stderr, "perf_event_open failed; hardware counters disabled\n"); }
+    }
+
+    struct corpus c;
+    buildCorpus(&c, CORPUS_SIZE);
+
+    if (csv)
+    {
+        printf("benchmark,calls_per_sample,samples,median_ns_per_call,mean_ns_per_call,"
+                "outliers,calls_per_sec,cycles_per_call,instructions_per_call\n");
+    }
+    else
+    {
+        printf("%d positions, %d samples per benchmark\n\n", c.n_positions, n_samples);
+        printf("%-24s %12s %12s %14s %9s", "benchmark", "median ns", "mean ns", "calls/sec", "outliers");
+        if (pc != NULL) { printf(" %10s %10s", "cycles", "instrs"); }
+        printf("\n");
+    }
+
+    for (size_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++)
+    {
+        struct result r = runBenchmark(&benchmarks[i], &c, n_samples, pc);
+        double calls_per_sec = 1e9 / r.median_ns;
+
+        if (csv)
+        {
+            printf("%s,%lld,%d,%.3f,%.3f,%d,%.0f,", benchmarks[i].name, r.calls, n_samples,
+                    r.median_ns, r.mean_ns, r.n_outliers, calls_per_sec);
+            if (r.cycles >= 0) { printf("%.1f", r.cycles); }
+            printf(",");
+            if (r.instructions >= 0) { printf("%.1f", r.instructions); }
+            printf("\n");
+        }
+        else
+        {
+            printf("%-24s %12.2f %12.2f %14.0f %9d", benchmarks[i].name,
+                    r.median_ns, r.mean_ns, calls_per_sec, r.n_outliers);
+            if (pc != NULL) { printf(" %10.1f %10.1f", r.cycles, r.instructions); }
+            printf("\n");
+        }
+    }
+
+    freeCorpus(&c);
+    return 0;
+}
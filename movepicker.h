@@ -0,0 +1,237 @@
+#ifndef MOVEPICKER_H
+#define MOVEPICKER_H
+
+#include "board.h"
+#include "moves.h"
+
+/*
+ * The move picker hands the search one move at a time, generating each
+ * batch of moves only once the previous batch has run out:
+ *
+ *   1. the hash move (the best move found here by an earlier search)
+ *   2. captures and promotions, most valuable victim first
+ *   3. killer moves (quiet moves that caused a cutoff at the same ply) and
+ *      the counter-move (the quiet move that last refuted the opponent's
+ *      previous move)
+ *   4. all other quiet moves, in order of their history score
+ *
+ * A beta cutoff early on then saves generating the quiet moves at all.
+ * The hash move and refutations come from other positions, so they are
+ * checked for legality before being handed out; generated moves are legal
+ * already.
+ * https://www.chessprogramming.org/Move_Generation#Staged_Move_Generation
+ * https://www.chessprogramming.org/Move_Ordering
+ */
+
+enum pickerStage
+{
+    STAGE_HASH,
+    STAGE_GEN_NOISY,
+    STAGE_NOISY,
+    STAGE_REFUTATIONS,
+    STAGE_GEN_QUIET,
+    STAGE_QUIET,
+    STAGE_DONE
+};
+
+#define N_KILLERS 2
+#define N_REFUTATIONS (N_KILLERS + 1)
+
+// Piece values used only to order captures.
+static const int mvv_lva_values[7] = {
+    [PAWN] = 1,
+    [KNIGHT] = 3,
+    [BISHOP] = 3,
+    [ROOK] = 5,
+    [QUEEN] = 9,
+    [KING] = 0,
+};
+
+struct movePicker
+{
+    const struct board *b;
+    struct legality l;
+    enum pickerStage stage;
+
+    struct move hash_move;
+    struct move refutations[N_REFUTATIONS];
+    int i_refutation;
+
+    // History scores of quiet moves for the side to move, by (from, to)
+    const int (*history)[64];
+
+    // At the root, moves that score the same are put in random order,
+    // drawn from this generator (NULL to keep them in generated order)
+    uint64_t *tie_rng;
+
+    // In quiescence search, stop once the captures and promotions run out
+    bool noisy_only;
+
+    struct moveList list;
+    int scores[MAX_MOVES];
+    int i_move;
+};
+
+void initMovePicker(struct movePicker *mp, const struct board *b,
+        struct move hash_move, const struct move *killers, struct move counter_move,
+        const int (*history)[64])
+{
+    mp->b = b;
+    computeLegality(b, &mp->l);
+    mp->stage = STAGE_HASH;
+    mp->hash_move = hash_move;
+    mp->i_refutation = 0;
+    mp->history = history;
+    mp->tie_rng = NULL;
+    mp->noisy_only = false;
+
+    for (int i = 0; i < N_KILLERS; i++)
+    {
+        mp->refutations[i] = killers ? killers[i] : NO_MOVE;
+    }
+    mp->refutations[N_KILLERS] = counter_move;
+}
+
+static bool isRefutation(const struct movePicker *mp, struct move m)
+{
+    for (int i = 0; i < N_REFUTATIONS; i++)
+    {
+        if (movesEqual(&m, &mp->refutations[i])) { return true; }
+    }
+    return false;
+}
+
+/*
+ * Captures are ordered by Most Valuable Victim, then Least Valuable
+ * Attacker. A promotion counts as capturing the piece it promotes to, so
+ * queen promotions come first and under-promotions come after every
+ * capture.
+ */
+static int scoreNoisy(const struct board *b, struct move m)
+{
+    int attacker = b->pieces[moveFrom(m)] & PIECE_TYPE;
+    int victim = (moveFlags(m) == MOVE_EP_CAPTURE) ? PAWN : (b->pieces[moveTo(m)] & PIECE_TYPE);
+    int score = 16 * mvv_lva_values[victim] - mvv_lva_values[attacker];
+
+    int promotion = movePromotion(m);
+    if (promotion == QUEEN) { score += 16 * mvv_lva_values[QUEEN]; }
+    else if (promotion != NONE) { score -= 16 * mvv_lva_values[QUEEN]; }
+
+    return score;
+}
+
+static void scoreMoves(struct movePicker *mp, bool noisy)
+{
+    for (int i = 0; i < mp->list.n_moves; i++)
+    {
+        struct move m = mp->list.moves[i];
+        int score = noisy ? scoreNoisy(mp->b, m)
+            : mp->history ? mp->history[moveFrom(m)][moveTo(m)]
+            : 0;
+
+        // Low bits break ties, randomly at the root
+        mp->scores[i] = score * 256 + (mp->tie_rng ? random64(mp->tie_rng) % 256 : 0);
+    }
+}
+
+// Swap the best-scoring move left in the list to the front and return it.
+static struct move pickBest(struct movePicker *mp)
+{
+    int best = mp->i_move;
+    for (int i = mp->i_move + 1; i < mp->list.n_moves; i++)
+    {
+        if (mp->scores[i] > mp->scores[best]) { best = i; }
+    }
+
+    struct move m = mp->list.moves[best];
+    mp->list.moves[best] = mp->list.moves[mp->i_move];
+    mp->list.moves[mp->i_move] = m;
+    mp->scores[best] = mp->scores[mp->i_move];
+
+    mp->i_move++;
+    return m;
+}
+
+/*
+ * The next move to search, or NO_MOVE once every legal move has been
+ * handed out.
+ */
+struct move nextMove(struct movePicker *mp)
+{
+    while (true)
+    {
+        switch (mp->stage)
+        {
+            case STAGE_HASH:
+                mp->stage = STAGE_GEN_NOISY;
+                if (mp->hash_move.data != NO_MOVE.data
+                        && isMoveLegalHere(mp->b, &mp->l, mp->hash_move))
+                {
+                    return mp->hash_move;
+                }
+                break;
+
+            case STAGE_GEN_NOISY:
+                init_movelist(&mp->list);
+                genMoves(mp->b, &mp->l, GEN_NOISY, &mp->list);
+                scoreMoves(mp, true);
+                mp->i_move = 0;
+                mp->stage = STAGE_NOISY;
+                break;
+
+            case STAGE_NOISY:
+                while (mp->i_move < mp->list.n_moves)
+                {
+                    struct move m = pickBest(mp);
+                    if (!movesEqual(&m, &mp->hash_move)) { return m; }
+                }
+                mp->stage = mp->noisy_only ? STAGE_DONE : STAGE_REFUTATIONS;
+                break;
+
+            case STAGE_REFUTATIONS:
+                while (mp->i_refutation < N_REFUTATIONS)
+                {
+                    int i = mp->i_refutation++;
+                    struct move m = mp->refutations[i];
+                    if (m.data == NO_MOVE.data) { continue; }
+                    if (movesEqual(&m, &mp->hash_move)) { continue; }
+                    if (moveIsCapture(m) || movePromotion(m) != NONE) { continue; }
+
+                    bool duplicate = false;
+                    for (int j = 0; j < i; j++)
+                    {
+                        if (movesEqual(&m, &mp->refutations[j])) { duplicate = true; }
+                    }
+                    if (duplicate) { continue; }
+
+                    if (isMoveLegalHere(mp->b, &mp->l, m)) { return m; }
+                }
+                mp->stage = STAGE_GEN_QUIET;
+                break;
+
+            case STAGE_GEN_QUIET:
+                init_movelist(&mp->list);
+                genMoves(mp->b, &mp->l, GEN_QUIET, &mp->list);
+                scoreMoves(mp, false);
+                mp->i_move = 0;
+                mp->stage = STAGE_QUIET;
+                break;
+
+            case STAGE_QUIET:
+                while (mp->i_move < mp->list.n_moves)
+                {
+                    struct move m = pickBest(mp);
+                    if (movesEqual(&m, &mp->hash_move)) { continue; }
+                    if (isRefutation(mp, m)) { continue; }
+                    return m;
+                }
+                mp->stage = STAGE_DONE;
+                break;
+
+            case STAGE_DONE:
+                return NO_MOVE;
+        }
+    }
+}
+
+#endif // MOVEPICKER_H
@@ -3,22 +3,89 @@
 
 #include "board.h"
 
+/*
+ * A move packed into 16 bits: the from square in bits 0-5, the to square in
+ * bits 6-11 and the move kind in bits 12-15.
+ * https://www.chessprogramming.org/Encoding_Moves
+ */
 struct move
 {
-    struct coord from;
-    struct coord to;
-    int promotion;
-    bool isCapture;
+    uint16_t data;
 };
 
+#define MOVE_QUIET          0x0
+#define MOVE_DOUBLE_PUSH    0x1
+#define MOVE_KING_CASTLE    0x2
+#define MOVE_QUEEN_CASTLE   0x3
+#define MOVE_CAPTURE        0x4
+#define MOVE_EP_CAPTURE     0x5
+// Promotions set this bit, plus MOVE_CAPTURE if they capture; the low two
+// bits give the new piece.
+#define MOVE_PROMOTION      0x8
+
+// The all-zero move (a1 to a1) never occurs, so it stands for "no move".
+#define NO_MOVE ((struct move) { 0 })
+
+static const int promotion_pieces[4] = { KNIGHT, BISHOP, ROOK, QUEEN };
+static const int promotion_codes[7] = { [KNIGHT] = 0, [BISHOP] = 1, [ROOK] = 2, [QUEEN] = 3 };
+
+static inline struct move encodeMove(int from, int to, int flags)
+{
+    return (struct move) { (uint16_t) (from | (to << 6) | (flags << 12)) };
+}
+
+static inline int moveFrom(struct move m) { return m.data & 0x3f; }
+static inline int moveTo(struct move m) { return (m.data >> 6) & 0x3f; }
+static inline int moveFlags(struct move m) { return m.data >> 12; }
+
+static inline bool moveIsCapture(struct move m)
+{
+    return (moveFlags(m) & MOVE_CAPTURE) != 0;
+}
+
+// The piece type a pawn promotes to, or NONE.
+static inline int movePromotion(struct move m)
+{
+    int flags = moveFlags(m);
+    return (flags & MOVE_PROMOTION) ? promotion_pieces[flags & 3] : NONE;
+}
+
+static inline struct coord squareCoord(int sq)
+{
+    return (struct coord) { RANK_OF(sq), FILE_OF(sq) };
+}
+
+static inline struct coord moveFromCoord(struct move m) { return squareCoord(moveFrom(m)); }
+static inline struct coord moveToCoord(struct move m) { return squareCoord(moveTo(m)); }
+
 bool movesEqual(const struct move *m1, const struct move *m2)
 {
-    return ((m1->from.rank == m2->from.rank)
-            && (m1->from.file == m2->from.file)
-            && (m1->to.rank == m2->to.rank)
-            && (m1->to.file == m2->to.file)
-            && (m1->promotion == m2->promotion)
-            && (m1->isCapture == m2->isCapture));
+    return m1->data == m2->data;
+}
+
+/*
+ * Write a move in coordinate notation (e.g. "e2e4", "e7e8q") into str,
+ * which must hold at least 6 characters.
+ */
+void moveString(struct move m, char *str)
+{
+    struct coord from = moveFromCoord(m);
+    struct coord to = moveToCoord(m);
+
+    *str++ = from.file + 'a';
+    *str++ = from.rank + '1';
+    *str++ = to.file + 'a';
+    *str++ = to.rank + '1';
+
+    switch (movePromotion(m))
+    {
+        case QUEEN:     *str++ = 'q'; break;
+        case BISHOP:    *str++ = 'b'; break;
+        case KNIGHT:    *str++ = 'n'; break;
+        case ROOK:      *str++ = 'r'; break;
+    }
+
+    *str = '\0';
 }
 
 // Max possible moves that could be made from one position.
@@ -36,6 +103,16 @@ void init_movelist(struct moveList *list)
     list->n_moves = 0;
 }
 
+/*
+ * What applyMove destroys, so that undoMove can restore the board exactly.
+ */
+struct undo
+{
+    int captured;
+    int castles_available;
+    struct coord ep_target;
+};
+
 bool isKingInCheck(const struct board *b);
 bool leavesKingInDanger(const struct board *b, struct move m);
 void genAllPseudoLegalMoves(const struct board *b, struct moveList *list);
@@ -45,636 +122,719 @@ void genPseudoLegalMovesForPiece(const struct board *b, struct coord from, struc
 bool isMoveLegal(const struct board *b, struct move m);
 
 
-void applyMove(struct board *b, struct move m)
+/*
+ * Castling rights that survive a move touching each square. Moving a king
+ * or rook from its original square - or capturing a rook there - gives up
+ * castling on that side.
+ */
+static const int castle_rights_kept[64] = {
+    [SQUARE(0, 0)] = ~CASTLE_WQ,
+    [SQUARE(0, 4)] = ~(CASTLE_WK | CASTLE_WQ),
+    [SQUARE(0, 7)] = ~CASTLE_WK,
+    [SQUARE(7, 0)] = ~CASTLE_BQ,
+    [SQUARE(7, 4)] = ~(CASTLE_BK | CASTLE_BQ),
+    [SQUARE(7, 7)] = ~CASTLE_BK,
+};
+
+static inline int castleRightsKept(int sq)
 {
-    int piece = get_piece(b, m.from);
-    int target_piece = get_piece(b, m.to);
-    bool is_ep_capture = (b->ep_target.rank == m.to.rank && b->ep_target.file == m.to.file);
+    return castle_rights_kept[sq] ? castle_rights_kept[sq] : ~0;
+}
 
-    set_piece(b, m.from, NONE);
-    set_piece(b, m.to, piece);
-    b->ep_target.file = m.to.file;
-    b->ep_target.rank = -1;
+/*
+ * Build with -DDEBUG_HASH to check the incrementally updated hash against
+ * a full recomputation after every move and undo.
+ */
+static inline void checkHash(const struct board *b)
+{
+#ifdef DEBUG_HASH
+    if (b->hash != computeHash(b))
+    {
+        fprintf(stderr, "Hash mismatch: incremental %016llx, computed %016llx\n",
+                (unsigned long long) b->hash, (unsigned long long) computeHash(b));
+        abort();
+    }
+#else
+    (void) b;
+#endif
+}
+
+struct undo applyMove(struct board *b, struct move m)
+{
+    int from = moveFrom(m);
+    int to = moveTo(m);
+    int flags = moveFlags(m);
+    int piece = b->pieces[from];
+    int color = piece & PIECE_COLOR;
+
+    struct undo u = {
+        .captured = b->pieces[to],
+        .castles_available = b->castles_available,
+        .ep_target = b->ep_target
+    };
 
-    switch (piece)
+    // An en-passant capture takes the pawn beside the mover
+    if (flags == MOVE_EP_CAPTURE)
     {
-        // Moving a king means you can no longer castle in either direction.
-        case WHITE | KING:
-            if (m.to.file - m.from.file == 2) // Move rook for kingside castle
-            {
-                set_piece(b, (struct coord) {0, 5}, WHITE | ROOK);
-                set_piece(b, (struct coord) {0, 7}, NONE);
-            }
-            else if (m.to.file - m.from.file == -2) // Move rook for queenside castle
-            {
-                set_piece(b, (struct coord) {0, 3}, WHITE | ROOK);
-                set_piece(b, (struct coord) {0, 0}, NONE);
-            }
+        int captured_sq = SQUARE(RANK_OF(from), FILE_OF(to));
+        u.captured = b->pieces[captured_sq];
+        set_square(b, captured_sq, NONE);
+    }
 
-            b->castles_available &= ~(CASTLE_WK | CASTLE_WQ);
-            break;
+    set_square(b, from, NONE);
+    set_square(b, to, (flags & MOVE_PROMOTION) ? (color | movePromotion(m)) : piece);
 
-        case BLACK | KING:
-            if (m.to.file - m.from.file == 2) // Move rook for kingside castle
-            {
-                set_piece(b, (struct coord) {7, 5}, BLACK | ROOK);
-                set_piece(b, (struct coord) {7, 7}, NONE);
-            }
-            else if (m.to.file - m.from.file == -2) // Move rook for queenside castle
-            {
-                set_piece(b, (struct coord) {7, 3}, BLACK | ROOK);
-                set_piece(b, (struct coord) {7, 0}, NONE);
-            }
+    // Move the rook for a castle
+    if (flags == MOVE_KING_CASTLE)
+    {
+        set_square(b, from + 3, NONE);
+        set_square(b, from + 1, color | ROOK);
+    }
+    else if (flags == MOVE_QUEEN_CASTLE)
+    {
+        set_square(b, from - 4, NONE);
+        set_square(b, from - 1, color | ROOK);
+    }
 
-            b->castles_available &= ~(CASTLE_BK | CASTLE_BQ);
-            break;
+    // set_square has already hashed the pieces in and out; the rest of the
+    // key is updated here.
+    int castles = b->castles_available & castleRightsKept(from) & castleRightsKept(to);
+    b->hash ^= zobrist_castles[b->castles_available] ^ zobrist_castles[castles];
+    b->castles_available = castles;
 
-        // Moving a rook from one of the two original rook spots means you can
-        // no longer castle in that rook's direction. Promoted rooks shouldn't
-        // affect this!
-        case WHITE | ROOK:
-            if (m.from.rank == 0 && m.from.file == 0)
-            {
-                b->castles_available &= ~CASTLE_WQ;
-            }
-            else if (m.from.rank == 0 && m.from.file == 7)
-            {
-                b->castles_available &= ~CASTLE_WK;
-            }
-            break;
+    // Set up future en-passant flag
+    b->hash ^= zobristEP(b->ep_target);
+    if (flags == MOVE_DOUBLE_PUSH)
+    {
+        b->ep_target = squareCoord((from + to) / 2);
+    }
+    else
+    {
+        b->ep_target.rank = -1;
+        b->ep_target.file = -1;
+    }
+    b->hash ^= zobristEP(b->ep_target);
 
-        case BLACK | ROOK:
-            if (m.from.rank == 7 && m.from.file == 0)
-            {
-                b->castles_available &= ~CASTLE_BQ;
-            }
-            else if (m.from.rank == 7 && m.from.file == 7)
-            {
-                b->castles_available &= ~CASTLE_BK;
-            }
-            break;
+    b->white_to_move ^= 1;
+    b->hash ^= zobrist_black_to_move;
 
-        case WHITE | PAWN:
-            // Apply en-passant capture
-            if (is_ep_capture)
-            {
-                set_piece(b, (struct coord) { 4, m.to.file }, NONE);
-            }
-            // Set up future en-passant flag
-            if (m.from.rank == 1 && m.to.rank == 3)
-            {
-                b->ep_target.rank = 2;
-            }
-            break;
+    checkHash(b);
+    return u;
+}
 
-        case BLACK | PAWN:
-            // Apply en-passant capture
-            if (is_ep_capture)
-            {
-                set_piece(b, (struct coord) { 3, m.to.file }, NONE);
-            }
-            // Set up future en-passant flag
-            if (m.from.rank == 6 && m.to.rank == 4)
-            {
-                b->ep_target.rank = 5;
-            }
-            break;
-    }
+/*
+ * Take back a move made by applyMove, given the undo record it returned.
+ */
+void undoMove(struct board *b, struct move m, struct undo u)
+{
+    int from = moveFrom(m);
+    int to = moveTo(m);
+    int flags = moveFlags(m);
+    int piece = b->pieces[to];
 
-    // Capturing a rook means the opponent can't castle on that side anymore.
-    switch (target_piece)
+    if (flags & MOVE_PROMOTION)
     {
-        case WHITE | ROOK:
-            if (m.to.rank == 0 && m.to.file == 0)
-            {
-                b->castles_available &= ~CASTLE_WQ;
-            }
-            else if (m.to.rank == 0 && m.to.file == 7)
-            {
-                b->castles_available &= ~CASTLE_WK;
-            }
-            break;
+        piece = (piece & PIECE_COLOR) | PAWN;
+    }
 
-        case BLACK | ROOK:
-            if (m.to.rank == 7 && m.to.file == 0)
-            {
-                b->castles_available &= ~CASTLE_BQ;
-            }
-            else if (m.to.rank == 7 && m.to.file == 7)
-            {
-                b->castles_available &= ~CASTLE_BK;
-            }
-            break;
+    set_square(b, to, NONE);
+    set_square(b, from, piece);
+
+    if (flags == MOVE_EP_CAPTURE)
+    {
+        set_square(b, SQUARE(RANK_OF(from), FILE_OF(to)), u.captured);
+    }
+    else if (u.captured != NONE)
+    {
+        set_square(b, to, u.captured);
     }
 
-    if (m.promotion != NONE)
+    // Put the rook back after a castle
+    if (flags == MOVE_KING_CASTLE)
+    {
+        set_square(b, from + 1, NONE);
+        set_square(b, from + 3, (piece & PIECE_COLOR) | ROOK);
+    }
+    else if (flags == MOVE_QUEEN_CASTLE)
     {
-        set_piece(b, m.to, (piece & PIECE_COLOR) | m.promotion);
+        set_square(b, from - 1, NONE);
+        set_square(b, from - 4, (piece & PIECE_COLOR) | ROOK);
     }
 
+    b->hash ^= zobrist_castles[b->castles_available] ^ zobrist_castles[u.castles_available];
+    b->castles_available = u.castles_available;
+
+    b->hash ^= zobristEP(b->ep_target) ^ zobristEP(u.ep_target);
+    b->ep_target = u.ep_target;
+
     b->white_to_move ^= 1;
-}
+    b->hash ^= zobrist_black_to_move;
 
-void initMoveList(struct moveList *list)
-{
-    memset(list, 0, sizeof(list));
+    checkHash(b);
 }
 
-void addMove(struct moveList *list, struct move m)
+/*
+ * Pass the turn without moving, as null-move pruning in the search does.
+ * Only the side to move and the en-passant target change.
+ */
+struct undo applyNullMove(struct board *b)
 {
-    list->moves[list->n_moves++] = m;
-}
+    struct undo u = {
+        .captured = NONE,
+        .castles_available = b->castles_available,
+        .ep_target = b->ep_target
+    };
 
-enum moveType
-{
-    FREE,
-    CAPTURE,
-    INVALID
-};
+    b->hash ^= zobristEP(b->ep_target);
+    b->ep_target.rank = -1;
+    b->ep_target.file = -1;
+
+    b->white_to_move ^= 1;
+    b->hash ^= zobrist_black_to_move;
 
-enum moveType getMoveType(const struct board *b, int piece, struct move m, struct moveList *list)
+    checkHash(b);
+    return u;
+}
+
+void undoNullMove(struct board *b, struct undo u)
 {
-    struct coord to = m.to;
-    if (to.rank < 0 || to.rank > 7) { return INVALID; }
-    if (to.file < 0 || to.file > 7) { return INVALID; }
+    b->hash ^= zobristEP(u.ep_target);
+    b->ep_target = u.ep_target;
 
-    int friendly_color = piece & PIECE_COLOR;
-    bool white = (friendly_color & WHITE) > 0;
+    b->white_to_move ^= 1;
+    b->hash ^= zobrist_black_to_move;
 
-    // You can't move nothing.
-    if (friendly_color == NONE) { return INVALID; }
-    int target_piece = get_piece(b, to);
+    checkHash(b);
+}
 
-    // You can't capture a piece of your own color.
-    if (friendly_color == (target_piece & PIECE_COLOR)) { return INVALID; }
+/*
+ * Find the legal move written as str in coordinate notation (see
+ * moveString). Returns false if there is no such move.
+ */
+bool parseMove(const struct board *b, const char *str, struct move *m)
+{
+    struct moveList ml;
+    init_movelist(&ml);
+    genAllMoves(b, &ml);
 
-    // All squares between the king and the rook must be vacant.
-    int piece_type = piece & PIECE_TYPE;
-    switch (piece_type)
+    for (int i = 0; i < ml.n_moves; i++)
     {
-        case KING:
-            struct coord inbetween = { .rank = m.from.rank };
-
-            // Kingside castle
-            if (m.to.file - m.from.file == 2)
-            {
-                int avail_flag = white ? CASTLE_WK : CASTLE_BK;
-                if (!(b->castles_available & avail_flag)) { return INVALID; }
+        char candidate[6];
+        moveString(ml.moves[i], candidate);
+        if (strcmp(candidate, str) == 0)
+        {
+            *m = ml.moves[i];
+            return true;
+        }
+    }
+    return false;
+}
 
-                for (inbetween.file = m.from.file + 1; inbetween.file < 7; inbetween.file++)
-                {
-                    if (get_piece(b, inbetween) != NONE) { return INVALID; }
-                }
-            }
-            // Queenside castle
-            else if (m.to.file - m.from.file == -2)
-            {
-                int avail_flag = white ? CASTLE_WQ : CASTLE_BQ;
-                if (!(b->castles_available & avail_flag)) { return INVALID; }
+/*
+ * Apply a space-separated list of moves in coordinate notation ("e2e4 e7e5").
+ * Stops at the first move that is not legal, and returns false.
+ */
+bool applyMoveStrings(struct board *b, const char *moves)
+{
+    char move_str[6];
+    int len = 0;
 
-                for (inbetween.file = m.from.file - 1; inbetween.file > 0; inbetween.file--)
-                {
-                    if (get_piece(b, inbetween) != NONE) { return INVALID; }
-                }
-            }
+    for (const char *c = moves; ; c++)
+    {
+        if (*c != ' ' && *c != '\0' && *c != '\n')
+        {
+            if (len < 5) { move_str[len++] = *c; }
+            continue;
+        }
 
-            break;
+        if (len > 0)
+        {
+            move_str[len] = '\0';
+            len = 0;
 
-        case PAWN:
-            // En passant is a valid capture even though the target square contains no piece
-            if (m.to.rank == b->ep_target.rank && m.to.file == b->ep_target.file)
-            {
-                return CAPTURE;
-            }
+            struct move m;
+            if (!parseMove(b, move_str, &m)) { return false; }
+            applyMove(b, m);
+        }
 
-            break;
+        if (*c == '\0') { return true; }
     }
+}
+
+void initMoveList(struct moveList *list)
+{
+    memset(list, 0, sizeof(list));
+}
 
-    if ((target_piece & PIECE_COLOR) == NONE) { return FREE; }
-    return CAPTURE;
+void addMove(struct moveList *list, struct move m)
+{
+    list->moves[list->n_moves++] = m;
 }
 
 /*
- * Add a move - unless it's a pawn promotion, in which case add all the possible promotions.
+ * Add a pawn move - unless it's a pawn promotion, in which case add all the possible promotions.
  */
-void addMoveMaybePawnPromo(int piece, struct moveList *list, struct move m)
+void addPawnMove(struct moveList *list, int from, int to, int flags)
 {
-    bool white = (piece & PIECE_COLOR) == WHITE;
-
-    if ((piece & PIECE_TYPE) == PAWN && m.promotion == NONE && m.to.rank == (white ? 7 : 0))
+    if (to >= SQUARE(7, 0) || to < SQUARE(1, 0))
     {
-        m.promotion = QUEEN;
-        addMove(list, m);
-        m.promotion = BISHOP;
-        addMove(list, m);
-        m.promotion = KNIGHT;
-        addMove(list, m);
-        m.promotion = ROOK;
-        addMove(list, m);
+        flags |= MOVE_PROMOTION;
+        addMove(list, encodeMove(from, to, flags | promotion_codes[QUEEN]));
+        addMove(list, encodeMove(from, to, flags | promotion_codes[BISHOP]));
+        addMove(list, encodeMove(from, to, flags | promotion_codes[KNIGHT]));
+        addMove(list, encodeMove(from, to, flags | promotion_codes[ROOK]));
     }
     else
     {
-        addMove(list, m);
+        addMove(list, encodeMove(from, to, flags));
     }
 }
 
-enum moveType tryAddMove(const struct board *b, int piece, struct coord from, struct coord to, struct moveList *list)
+/*
+ * Add one move from `from` to every square in `targets`.
+ */
+void addMovesToTargets(const struct board *b, int from, uint64_t targets, struct moveList *list)
 {
-    struct move m = {.from = from, .to = to, .promotion = NONE};
-    enum moveType mt = getMoveType(b, piece, m, list);
-    m.isCapture = (mt == CAPTURE);
+    int enemy_index = COLOR_INDEX(b->pieces[from]) ^ 1;
+    uint64_t enemies = b->bitboards[enemy_index][NONE];
 
-    if (mt != INVALID)
+    while (targets)
     {
-        addMoveMaybePawnPromo(piece, list, m);
+        int to = popLSB(&targets);
+        addMove(list, encodeMove(from, to, (enemies & SQUARE_BB(to)) ? MOVE_CAPTURE : MOVE_QUIET));
     }
+}
 
-    return mt;
+uint64_t epTargetBB(const struct board *b)
+{
+    if (b->ep_target.rank < 0 || b->ep_target.file < 0) { return 0; }
+    return SQUARE_BB(SQUARE(b->ep_target.rank, b->ep_target.file));
 }
 
-enum moveType tryAddMoveRestricted(const struct board *b, int piece, struct coord from, struct coord to, struct moveList *list, enum moveType requiredType)
+/*
+ * Is the given square attacked by any piece of the given color index?
+ * We look outwards from the square as if it held each kind of piece: if,
+ * say, a knight standing there could capture an enemy knight, then that
+ * enemy knight attacks the square.
+ */
+bool isSquareAttacked(const struct board *b, int sq, int attacker_index)
 {
-    struct move m = {.from = from, .to = to, .promotion = NONE};
-    enum moveType mt = getMoveType(b, piece, m, list);
-    m.isCapture = (mt == CAPTURE);
+    const uint64_t *attackers = b->bitboards[attacker_index];
+    uint64_t occ = occupied(b);
 
-    if (mt == requiredType)
-    {
-        addMoveMaybePawnPromo(piece, list, m);
-    }
+    if (pawn_attacks[attacker_index ^ 1][sq] & attackers[PAWN]) { return true; }
+    if (knight_attacks[sq] & attackers[KNIGHT]) { return true; }
+    if (king_attacks[sq] & attackers[KING]) { return true; }
+    if (bishopAttacks(sq, occ) & (attackers[BISHOP] | attackers[QUEEN])) { return true; }
+    if (rookAttacks(sq, occ) & (attackers[ROOK] | attackers[QUEEN])) { return true; }
 
-    return mt;
+    return false;
 }
 
-void genPseudoLegalMovesForPiece(const struct board *b, struct coord from, struct moveList *list)
+uint64_t attackersTo(const struct board *b, int sq, uint64_t occ, int attacker_index)
 {
-    int piece = get_piece(b, from);
-    int piece_color = piece & PIECE_COLOR;
-    int piece_type = piece & PIECE_TYPE;
+    const uint64_t *attackers = b->bitboards[attacker_index];
 
-    bool slide_ortho = false;
-    bool slide_diag = false;
+    return (pawn_attacks[attacker_index ^ 1][sq] & attackers[PAWN])
+        | (knight_attacks[sq] & attackers[KNIGHT])
+        | (king_attacks[sq] & attackers[KING])
+        | (bishopAttacks(sq, occ) & (attackers[BISHOP] | attackers[QUEEN]))
+        | (rookAttacks(sq, occ) & (attackers[ROOK] | attackers[QUEEN]));
+}
 
-    switch (piece_type)
-    {
-        case KING:
-            // Regular moves
-            tryAddMove(b, piece, from, (struct coord) { from.rank,     from.file + 1 }, list);
-            tryAddMove(b, piece, from, (struct coord) { from.rank,     from.file - 1 }, list);
-            tryAddMove(b, piece, from, (struct coord) { from.rank + 1, from.file + 1 }, list);
-            tryAddMove(b, piece, from, (struct coord) { from.rank + 1, from.file     }, list);
-            tryAddMove(b, piece, from, (struct coord) { from.rank + 1, from.file - 1 }, list);
-            tryAddMove(b, piece, from, (struct coord) { from.rank - 1, from.file + 1 }, list);
-            tryAddMove(b, piece, from, (struct coord) { from.rank - 1, from.file     }, list);
-            tryAddMove(b, piece, from, (struct coord) { from.rank - 1, from.file - 1 }, list);
-
-            // Castling moves
-            tryAddMove(b, piece, from, (struct coord) { from.rank,     from.file + 2 }, list);
-            tryAddMove(b, piece, from, (struct coord) { from.rank,     from.file - 2 }, list);
+/*
+ * Every square attacked by the given color index, with sliders treating
+ * `occ` as the board's occupancy.
+ */
+uint64_t attackedSquares(const struct board *b, int attacker_index, uint64_t occ)
+{
+    const uint64_t *attackers = b->bitboards[attacker_index];
+    uint64_t pawns = attackers[PAWN];
+    uint64_t attacked = (attacker_index == 1)
+        ? ((pawns & ~FILE_A_BB) << 7) | ((pawns & ~FILE_H_BB) << 9)
+        : ((pawns & ~FILE_A_BB) >> 9) | ((pawns & ~FILE_H_BB) >> 7);
 
-            return;
+    uint64_t bb = attackers[KNIGHT];
+    while (bb) { attacked |= knight_attacks[popLSB(&bb)]; }
 
-        case KNIGHT:
-            tryAddMove(b, piece, from, (struct coord) { from.rank + 1, from.file + 2 }, list);
-            tryAddMove(b, piece, from, (struct coord) { from.rank + 1, from.file - 2 }, list);
-            tryAddMove(b, piece, from, (struct coord) { from.rank - 1, from.file + 2 }, list);
-            tryAddMove(b, piece, from, (struct coord) { from.rank - 1, from.file - 2 }, list);
-            tryAddMove(b, piece, from, (struct coord) { from.rank + 2, from.file + 1 }, list);
-            tryAddMove(b, piece, from, (struct coord) { from.rank + 2, from.file - 1 }, list);
-            tryAddMove(b, piece, from, (struct coord) { from.rank - 2, from.file + 1 }, list);
-            tryAddMove(b, piece, from, (struct coord) { from.rank - 2, from.file - 1 }, list);
+    bb = attackers[BISHOP] | attackers[QUEEN];
+    while (bb) { attacked |= bishopAttacks(popLSB(&bb), occ); }
 
-            return;
+    bb = attackers[ROOK] | attackers[QUEEN];
+    while (bb) { attacked |= rookAttacks(popLSB(&bb), occ); }
 
-        case PAWN:
-            bool white = piece_color == WHITE;
-            int startRank = white ? 1 : 6;
-            int dir = white ? 1 : -1;
-            int singlePushRank = from.rank + dir;
-            int doublePushRank = singlePushRank + dir;
+    bb = attackers[KING];
+    while (bb) { attacked |= king_attacks[popLSB(&bb)]; }
 
-            // Straight forward single pushes cannot be captures
-            enum moveType singlePush =
-                tryAddMoveRestricted(b, piece, from, (struct coord) { singlePushRank, from.file }, list, FREE);
+    return attacked;
+}
 
-            // Diagonal forward pushes must be captures
-            tryAddMoveRestricted(b, piece, from, (struct coord) { singlePushRank, from.file-1 }, list, CAPTURE);
-            tryAddMoveRestricted(b, piece, from, (struct coord) { singlePushRank, from.file+1 }, list, CAPTURE);
+bool canNextMoveDestroyKing(const struct board *b)
+{
+    int attacker_index = b->white_to_move ? 1 : 0;
+    int king_sq = b->king_sq[attacker_index ^ 1];
+    if (king_sq < 0) { return false; }
 
-            // Double push
-            if (singlePush == FREE && from.rank == startRank)
-            {
-                tryAddMoveRestricted(b, piece, from, (struct coord) { doublePushRank, from.file }, list, FREE);
-            }
+    return isSquareAttacked(b, king_sq, attacker_index);
+}
 
-            return;
+bool isKingInCheck(const struct board *b)
+{
+    // The king is ~currently~ in check if the opponent attacks its square.
+    int friendly_index = b->white_to_move ? 1 : 0;
+    int king_sq = b->king_sq[friendly_index];
+    if (king_sq < 0) { return false; }
 
-        case ROOK:
-            slide_ortho = true;
+    return isSquareAttacked(b, king_sq, friendly_index ^ 1);
+}
+
+/*
+ * Would making this move leave the mover's own king attacked? Rather than
+ * making the move on a copy of the board, we work out which squares the
+ * move empties and fills, and test the king square against the opponent's
+ * pieces in that hypothetical occupancy.
+ */
+bool leavesKingInDanger(const struct board *b, struct move m)
+{
+    int from = moveFrom(m);
+    int to = moveTo(m);
+    int flags = moveFlags(m);
+    int piece = b->pieces[from];
+    int friendly_index = COLOR_INDEX(piece);
+    int enemy_index = friendly_index ^ 1;
+    const uint64_t *enemies = b->bitboards[enemy_index];
+
+    uint64_t captured = SQUARE_BB(to);
+    uint64_t occ = (occupied(b) & ~SQUARE_BB(from)) | SQUARE_BB(to);
+
+    switch (flags)
+    {
+        case MOVE_EP_CAPTURE:
+            captured = SQUARE_BB(SQUARE(RANK_OF(from), FILE_OF(to)));
+            occ &= ~captured;
             break;
 
-        case BISHOP:
-            slide_diag = true;
+        // The castling rook ends up beside the king
+        case MOVE_KING_CASTLE:
+            occ = (occ & ~SQUARE_BB(from + 3)) | SQUARE_BB(from + 1);
             break;
 
-        case QUEEN:
-            slide_ortho = true;
-            slide_diag = true;
+        case MOVE_QUEEN_CASTLE:
+            occ = (occ & ~SQUARE_BB(from - 4)) | SQUARE_BB(from - 1);
             break;
     }
 
-    struct coord to;
+    int king_sq = ((piece & PIECE_TYPE) == KING) ? to : b->king_sq[friendly_index];
 
-    if (slide_ortho)
-    {
-        for (to.rank = from.rank, to.file = from.file + 1;
-                to.file <= 7; to.file++)
-        {
-            if (tryAddMove(b, piece, from, to, list) != FREE) { break; }
-        }
+    if (pawn_attacks[friendly_index][king_sq] & enemies[PAWN] & ~captured) { return true; }
+    if (knight_attacks[king_sq] & enemies[KNIGHT] & ~captured) { return true; }
+    if (king_attacks[king_sq] & enemies[KING]) { return true; }
+    if (bishopAttacks(king_sq, occ) & (enemies[BISHOP] | enemies[QUEEN]) & ~captured) { return true; }
+    if (rookAttacks(king_sq, occ) & (enemies[ROOK] | enemies[QUEEN]) & ~captured) { return true; }
 
-        for (to.rank = from.rank, to.file = from.file - 1;
-                to.file >= 0; to.file--)
-        {
-            if (tryAddMove(b, piece, from, to, list) != FREE) { break; }
-        }
-
-        for (to.rank = from.rank + 1, to.file = from.file;
-                to.rank <= 7; to.rank++)
-        {
-            if (tryAddMove(b, piece, from, to, list) != FREE) { break; }
-        }
+    return false;
+}
 
-        for (to.rank = from.rank - 1, to.file = from.file;
-                to.rank >= 0; to.rank--)
-        {
-            if (tryAddMove(b, piece, from, to, list) != FREE) { break; }
-        }
-    }
+/*
+ * What the legal move generator needs to know about a position, worked out
+ * once per position instead of once per move.
+ * https://www.chessprogramming.org/Checks_and_Pinned_Pieces_(Bitboards)
+ */
+struct legality
+{
+    int king_sq;
+    uint64_t checkers;      // enemy pieces giving check
+    uint64_t check_mask;    // where a non-king move must land to answer the check
+    uint64_t pinned;        // friendly pieces pinned against the king
+    uint64_t danger;        // squares the king must not step onto
+};
 
-    if (slide_diag)
-    {
-        for (to.rank = from.rank + 1, to.file = from.file + 1;
-                to.rank <= 7 && to.file <= 7;
-                to.rank++, to.file++)
-        {
-            if (tryAddMove(b, piece, from, to, list) != FREE) { break; }
-        }
+void computeLegality(const struct board *b, struct legality *l)
+{
+    int friendly_index = b->white_to_move ? 1 : 0;
+    int enemy_index = friendly_index ^ 1;
+    const uint64_t *enemies = b->bitboards[enemy_index];
+    uint64_t friends = b->bitboards[friendly_index][NONE];
+    uint64_t occ = occupied(b);
 
-        for (to.rank = from.rank + 1, to.file = from.file - 1;
-                to.rank <= 7 && to.file >= 0;
-                to.rank++, to.file--)
-        {
-            if (tryAddMove(b, piece, from, to, list) != FREE) { break; }
-        }
+    l->king_sq = b->king_sq[friendly_index];
+    l->checkers = attackersTo(b, l->king_sq, occ, enemy_index);
 
-        for (to.rank = from.rank - 1, to.file = from.file + 1;
-                to.rank >= 0 && to.file <= 7;
-                to.rank--, to.file++)
-        {
-            if (tryAddMove(b, piece, from, to, list) != FREE) { break; }
-        }
+    // Sliders see through the king, so that it can't step back along the
+    // line it is being checked on.
+    l->danger = attackedSquares(b, enemy_index, occ & ~SQUARE_BB(l->king_sq));
 
-        for (to.rank = from.rank - 1, to.file = from.file - 1;
-                to.rank >= 0 && to.file >= 0;
-                to.rank--, to.file--)
-        {
-            if (tryAddMove(b, piece, from, to, list) != FREE) { break; }
-        }
+    if (l->checkers == 0)
+    {
+        l->check_mask = ~0ULL;
     }
-}
-
-bool canNextMoveDestroyKing(const struct board *b)
-{
-    int attacker_color = b->white_to_move ? WHITE : BLACK;
-    int target_color = b->white_to_move ? BLACK : WHITE;
-
-    // Find the king on the board.
-    struct coord king_at;
-    bool found_king = false;
-    for (king_at.rank = 0; king_at.rank < 8; king_at.rank++)
+    else if (popcount(l->checkers) == 1)
     {
-        for (king_at.file = 0; king_at.file < 8; king_at.file++)
-        {
-            if (get_piece(b, king_at) == (target_color | KING))
-            {
-                found_king = true;
-                break;
-            }
-        }
-
-        if (found_king) { break; }
+        // Capture the checker, or block it if it is a slider
+        l->check_mask = l->checkers | between_bb[l->king_sq][bitscan(l->checkers)];
     }
-
-    // Check for pawns. (Don't check straight ahead!)
-    int offset_rank_pawn = b->white_to_move ? -1 : 1;
-    for (int offset_file = -1; offset_file <= 1; offset_file += 2)
+    else
     {
-        struct coord at = king_at;
-        at.rank += offset_rank_pawn;
-        at.file += offset_file;
-
-        if (at.rank < 0) { continue; }
-        if (at.rank > 7) { continue; }
-        if (at.file < 0) { continue; }
-        if (at.file > 7) { continue; }
+        // Double check: only the king can move
+        l->check_mask = 0;
+    }
 
-        int this_piece = get_piece(b, at);
-        if (this_piece == (attacker_color | PAWN)) {
-            return true;
+    // An enemy slider with exactly one friendly piece between it and the
+    // king pins that piece to the line between them.
+    l->pinned = 0;
+    uint64_t snipers = (rookAttacks(l->king_sq, 0) & (enemies[ROOK] | enemies[QUEEN]))
+        | (bishopAttacks(l->king_sq, 0) & (enemies[BISHOP] | enemies[QUEEN]));
+    while (snipers)
+    {
+        uint64_t blockers = between_bb[l->king_sq][popLSB(&snipers)] & occ;
+        if (popcount(blockers) == 1 && (blockers & friends))
+        {
+            l->pinned |= blockers;
         }
     }
+}
 
-    // Check for knights.
-    const struct coord knight_offsets[] = {
-        { -1, -2 }, { 1, -2 },
-        { -1, 2 }, { 1, 2 },
-        { -2, -1 }, { 2, -1 },
-        { -2, 1 }, { 2, 1 },
-    };
+// Which moves a generator call produces. Noisy moves are captures
+// (including en passant) and promotions; quiet moves are everything else.
+#define GEN_NOISY   0x1
+#define GEN_QUIET   0x2
+#define GEN_ALL     (GEN_NOISY | GEN_QUIET)
 
-    for (int i_offset = 0; i_offset < 8; i_offset++)
+/*
+ * Generate moves of the given kind for the piece on `sq`. Given the
+ * legality information for the position, only legal moves are generated;
+ * given NULL, every pseudo-legal move is.
+ */
+void genPieceMoves(const struct board *b, int sq, const struct legality *l, int kind, struct moveList *list)
+{
+    int piece = b->pieces[sq];
+    if (piece == NONE) { return; }
+
+    int friendly_index = COLOR_INDEX(piece);
+    uint64_t friends = b->bitboards[friendly_index][NONE];
+    uint64_t enemies = b->bitboards[friendly_index ^ 1][NONE];
+    uint64_t occ = friends | enemies;
+    uint64_t targets = 0;
+    uint64_t kind_mask = ((kind & GEN_NOISY) ? enemies : 0) | ((kind & GEN_QUIET) ? ~occ : 0);
+
+    // Non-king moves must answer any check, and pinned pieces must stay
+    // on the pin line.
+    uint64_t allowed = ~friends;
+    if (l)
     {
-        struct coord at = king_at;
-        struct coord offset = knight_offsets[i_offset];
-
-        at.rank += offset.rank;
-        at.file += offset.file;
-
-        if (at.rank < 0) { continue; }
-        if (at.rank > 7) { continue; }
-        if (at.file < 0) { continue; }
-        if (at.file > 7) { continue; }
-
-        int this_piece = get_piece(b, at);
-        if (this_piece == (attacker_color | KNIGHT)) { return true; }
+        allowed &= l->check_mask;
+        if (l->pinned & SQUARE_BB(sq))
+        {
+            allowed &= line_bb[l->king_sq][sq];
+        }
     }
 
-    // Here, we sort of scan the board as if the king were a queen. If it
-    // encounters a piece that could capture it in that direction, then it is
-    // endangered. For example, if we set out from the king diagonally, and
-    // encounter an enemy bishop before any other piece in that direction, then
-    // the king is endangered.
-
-    const struct coord sliding_offsets[] = {
-        { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 },
-        { -1, -1 }, { -1, 1 }, { 1, -1 }, { 1, 1 }
-    };
-
-    for (int i_offset = 0; i_offset < 8; i_offset++)
+    switch (piece & PIECE_TYPE)
     {
-        struct coord at = king_at;
-        struct coord offset = sliding_offsets[i_offset];
-        bool diagonal = ((offset.rank + offset.file + 2) % 2) == 0;
-        int steps = 0;
-        bool finished_slide = false;
+        case KING:
+            targets = king_attacks[sq] & kind_mask;
+            if (l) { targets &= ~l->danger; }
+            addMovesToTargets(b, sq, targets, list);
+
+            // Castling moves: the right must still be available, and all
+            // squares between the king and the rook must be vacant. The
+            // king must not leave, cross over, or arrive at an attacked
+            // square.
+            bool white = friendly_index == 1;
+            int castle_k = white ? CASTLE_WK : CASTLE_BK;
+            int castle_q = white ? CASTLE_WQ : CASTLE_BQ;
+            uint64_t between_k = SQUARE_BB(sq + 1) | SQUARE_BB(sq + 2);
+            uint64_t between_q = SQUARE_BB(sq - 1) | SQUARE_BB(sq - 2) | SQUARE_BB(sq - 3);
+            uint64_t crossing_q = SQUARE_BB(sq - 1) | SQUARE_BB(sq - 2);
+
+            if (!(kind & GEN_QUIET)) { return; }
+            if (l && l->checkers) { return; }
+
+            if ((b->castles_available & castle_k) && !(occ & between_k)
+                    && !(l && (l->danger & between_k)))
+            {
+                addMove(list, encodeMove(sq, sq + 2, MOVE_KING_CASTLE));
+            }
+            if ((b->castles_available & castle_q) && !(occ & between_q)
+                    && !(l && (l->danger & crossing_q)))
+            {
+                addMove(list, encodeMove(sq, sq - 2, MOVE_QUEEN_CASTLE));
+            }
 
-        while (true)
-        {
-            at.rank += offset.rank;
-            at.file += offset.file;
-            steps++;
+            return;
 
-            if (at.rank < 0) { break; }
-            if (at.rank > 7) { break; }
-            if (at.file < 0) { break; }
-            if (at.file > 7) { break; }
+        case KNIGHT:
+            targets = knight_attacks[sq] & allowed & kind_mask;
+            break;
 
-            int this_piece = get_piece(b, at);
-            int this_color = this_piece & PIECE_COLOR;
-            int this_type = this_piece & PIECE_TYPE;
+        case PAWN:
+            // Straight forward pushes cannot be captures. Pushes to the
+            // last rank are promotions, which count as noisy.
+            int dir = (friendly_index == 1) ? 8 : -8;
+            int start_rank = (friendly_index == 1) ? 1 : 6;
+            int promo_rank = (friendly_index == 1) ? 6 : 1;
+            int push_kind = (RANK_OF(sq) == promo_rank) ? GEN_NOISY : GEN_QUIET;
+            if (!(occ & SQUARE_BB(sq + dir)))
+            {
+                if ((allowed & SQUARE_BB(sq + dir)) && (kind & push_kind))
+                {
+                    addPawnMove(list, sq, sq + dir, MOVE_QUIET);
+                }
+                if (RANK_OF(sq) == start_rank && !(occ & SQUARE_BB(sq + 2*dir))
+                        && (allowed & SQUARE_BB(sq + 2*dir)) && (kind & GEN_QUIET))
+                {
+                    addMove(list, encodeMove(sq, sq + 2*dir, MOVE_DOUBLE_PUSH));
+                }
+            }
 
-            if (this_color == target_color) { break; }
-            if (this_color == NONE) { continue; }
+            if (!(kind & GEN_NOISY)) { return; }
 
-            switch (this_type)
+            // Diagonal forward pushes must be captures
+            targets = pawn_attacks[friendly_index][sq] & enemies & allowed;
+            while (targets)
             {
-                case QUEEN:
-                    return true;
+                addPawnMove(list, sq, popLSB(&targets), MOVE_CAPTURE);
+            }
 
-                case BISHOP:
-                    if (diagonal) { return true; }
-                    else { finished_slide = true; break; }
+            // En passant removes two pawns from the board at once, which can
+            // expose the king in ways the masks don't describe, so it is
+            // checked directly. It is rare enough for that not to matter.
+            if (pawn_attacks[friendly_index][sq] & epTargetBB(b))
+            {
+                struct move m = encodeMove(sq, SQUARE(b->ep_target.rank, b->ep_target.file), MOVE_EP_CAPTURE);
+                if (!l || !leavesKingInDanger(b, m))
+                {
+                    addMove(list, m);
+                }
+            }
 
-                case ROOK:
-                    if (!diagonal) { return true; }
-                    else { finished_slide = true; break; }
+            return;
 
-                case KING:
-                    if (steps == 1) { return true; }
-                    else { finished_slide = true; break; }
+        case ROOK:
+            targets = rookAttacks(sq, occ) & allowed & kind_mask;
+            break;
 
-                default: finished_slide = true; break;
-            }
+        case BISHOP:
+            targets = bishopAttacks(sq, occ) & allowed & kind_mask;
+            break;
 
-            if (finished_slide) { break; }
-        }
+        case QUEEN:
+            targets = queenAttacks(sq, occ) & allowed & kind_mask;
+            break;
     }
 
-    return false;
-}
-
-bool isKingInCheck(const struct board *b)
-{
-    // To check whether the king is ~currently~ in check,
-    // we flip control of (a copy of) the board without making a move.
-    // Then, we see if any of the responses can destroy the king.
-    struct board b2 = *b;
-    b2.white_to_move ^= 1;
-
-    return canNextMoveDestroyKing(&b2);
+    addMovesToTargets(b, sq, targets, list);
 }
 
-bool leavesKingInDanger(const struct board *b, struct move m)
+void genPseudoLegalMovesForPiece(const struct board *b, struct coord from, struct moveList *list)
 {
-    struct board b2 = *b;
-    applyMove(&b2, m);
-
-    return canNextMoveDestroyKing(&b2);
+    genPieceMoves(b, SQUARE(from.rank, from.file), NULL, GEN_ALL, list);
 }
 
 void genMovesForPiece(const struct board *b, struct coord from, struct moveList *list)
 {
     int piece = get_piece(b, from);
+    if (piece == NONE) { return; }
 
-    struct moveList listPseudoLegal;
-    init_movelist(&listPseudoLegal);
-    genPseudoLegalMovesForPiece(b, from, &listPseudoLegal);
-
-    int friendly_color = piece & PIECE_COLOR;
-    int enemy_color = (friendly_color == WHITE) ? BLACK : WHITE;
-
-    for (int i_move = 0; i_move < listPseudoLegal.n_moves; i_move++)
+    // The legality masks describe the side to move. For the other side's
+    // pieces, fall back to filtering the pseudo-legal moves.
+    if ((piece & PIECE_COLOR) != (b->white_to_move ? WHITE : BLACK))
     {
-        struct move m = listPseudoLegal.moves[i_move];
-        if (isMoveLegal(b, m))
+        struct moveList listPseudoLegal;
+        init_movelist(&listPseudoLegal);
+        genPseudoLegalMovesForPiece(b, from, &listPseudoLegal);
+
+        for (int i_move = 0; i_move < listPseudoLegal.n_moves; i_move++)
         {
-            addMove(list, m);
+            struct move m = listPseudoLegal.moves[i_move];
+            if (isMoveLegal(b, m))
+            {
+                addMove(list, m);
+            }
         }
+        return;
     }
+
+    struct legality l;
+    computeLegality(b, &l);
+    genPieceMoves(b, SQUARE(from.rank, from.file), &l, GEN_ALL, list);
 }
 
 bool isMoveLegal(const struct board *b, struct move m)
 {
-    int piece = get_piece(b, m.from);
-    if ((piece & PIECE_TYPE) == KING)
-    {
-        struct move tentative = { .from = m.from, .to.rank = m.from.rank };
+    int from = moveFrom(m);
+    int flags = moveFlags(m);
 
-        // King must not leave, cross over, or arrive at an attacked square.
-        if ((m.to.file - m.from.file) == 2)
-        {
-            for (tentative.to.file = m.from.file; tentative.to.file < 7; tentative.to.file++)
-            {
-                if (leavesKingInDanger(b, tentative)) { return false; }
-            }
-        }
-        else if ((m.to.file - m.from.file) == -2)
+    // King must not leave, cross over, or arrive at an attacked square.
+    if (flags == MOVE_KING_CASTLE || flags == MOVE_QUEEN_CASTLE)
+    {
+        int step = (flags == MOVE_KING_CASTLE) ? 1 : -1;
+        for (int sq = from; sq != moveTo(m); sq += step)
         {
-            for (tentative.to.file = m.from.file; tentative.to.file > 1; tentative.to.file--)
-            {
-                if (leavesKingInDanger(b, tentative)) { return false; }
-            }
+            if (leavesKingInDanger(b, encodeMove(from, sq, MOVE_QUIET))) { return false; }
         }
     }
 
     return !leavesKingInDanger(b, m);
 }
 
-
 void genAllPseudoLegalMoves(const struct board *b, struct moveList *list)
 {
-    int piece_color = b->white_to_move ? WHITE : BLACK;
+    int friendly_index = b->white_to_move ? 1 : 0;
 
-    for (int rank = 0; rank < 8; rank++)
+    for (int i = 0; i < b->piece_count[friendly_index]; i++)
     {
-        for (int file = 0; file < 8; file++)
-        {
-            struct coord at = {rank, file};
-            if ((get_piece(b, at) & PIECE_COLOR) == piece_color)
-            {
-                genPseudoLegalMovesForPiece(b, at, list);
-            }
-        }
+        genPieceMoves(b, b->piece_list[friendly_index][i], NULL, GEN_ALL, list);
+    }
+}
+
+/*
+ * Generate the legal moves of the given kind, using legality information
+ * already computed for the position.
+ */
+void genMoves(const struct board *b, const struct legality *l, int kind, struct moveList *list)
+{
+    int friendly_index = b->white_to_move ? 1 : 0;
+
+    // In double check, only the king has any moves.
+    if (l->check_mask == 0)
+    {
+        genPieceMoves(b, l->king_sq, l, kind, list);
+        return;
+    }
+
+    for (int i = 0; i < b->piece_count[friendly_index]; i++)
+    {
+        genPieceMoves(b, b->piece_list[friendly_index][i], l, kind, list);
     }
 }
 
 void genAllMoves(const struct board *b, struct moveList *list)
 {
-    int piece_color = b->white_to_move ? WHITE : BLACK;
-    int pieces_examined = 0;
+    struct legality l;
+    computeLegality(b, &l);
+    genMoves(b, &l, GEN_ALL, list);
+}
+
+/*
+ * Is this move - which may come from another position, such as a killer
+ * move or a remembered best move - legal here?
+ */
+bool isMoveLegalHere(const struct board *b, const struct legality *l, struct move m)
+{
+    int piece = b->pieces[moveFrom(m)];
+    if (piece == NONE || (piece & PIECE_COLOR) != (b->white_to_move ? WHITE : BLACK)) { return false; }
+    if (l->check_mask == 0 && (piece & PIECE_TYPE) != KING) { return false; }
+
+    struct moveList list;
+    init_movelist(&list);
+    genPieceMoves(b, moveFrom(m), l, GEN_ALL, &list);
 
-    for (int rank = 0; rank < 8; rank++)
+    for (int i = 0; i < list.n_moves; i++)
     {
-        for (int file = 0; file < 8; file++)
-        {
-            struct coord at = {rank, file};
-            if ((get_piece(b, at) & PIECE_COLOR) == piece_color)
-            {
-                genMovesForPiece(b, at, list);
-            }
-        }
+        if (list.moves[i].data == m.data) { return true; }
     }
+    return false;
 }
 
 #endif // MOVES_H
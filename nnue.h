@@ -0,0 +1,339 @@
+#ifndef NNUE_H
+#define NNUE_H
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/*
+ * An optional neural-network evaluation, in the style of Stockfish's NNUE
+ * ("efficiently updatable neural network").
+ * https://www.chessprogramming.org/NNUE
+ *
+ * The input is HalfKP-like: from each side's point of view ("perspective"),
+ * one feature for every non-king piece, given by that side's king square,
+ * the piece's type and color, and its square. Squares are flipped
+ * vertically for black, so both perspectives see the board from their own
+ * side. The first layer sums the weights of the active features into an
+ * accumulator per perspective. A move only switches a few features on or
+ * off, so the board keeps the accumulators up to date as pieces move (see
+ * set_square); only a king move forces that side's accumulator to be
+ * rebuilt, since every one of its features changes.
+ *
+ * The rest of the network is small:
+ *   accumulators (2 x NNUE_L1, int16) -> clipped ReLU -> int8
+ *   -> NNUE_L2 neurons (int8 weights, int32 sums) -> clipped ReLU
+ *   -> 1 output (int8 weights), in 1/NNUE_OUTPUT_SCALE centipawns.
+ *
+ * Network file format (all little-endian, no padding):
+ *   char     magic[8]            "CHESTNN1"
+ *   uint32   version             1
+ *   uint32   n_inputs            NNUE_INPUTS
+ *   uint32   l1                  NNUE_L1
+ *   uint32   l2                  NNUE_L2
+ *   uint32   reserved[2]         0
+ *   int16    ft_biases[l1]
+ *   int16    ft_weights[n_inputs][l1]
+ *   int32    l2_biases[l2]
+ *   int8     l2_weights[l2][2 * l1]   (side to move's half first)
+ *   int32    out_bias
+ *   int8     out_weights[l2]
+ * The file is mapped into memory rather than read, so the weights are
+ * shared between processes and only paged in as they are used.
+ *
+ * This header only knows about squares, piece types 1-5 and color indices
+ * (0 black, 1 white); board.h and eval.h connect it to the board.
+ */
+
+#define NNUE_KING_SQUARES 64
+#define NNUE_PIECE_KINDS 10
+#define NNUE_INPUTS (NNUE_KING_SQUARES * NNUE_PIECE_KINDS * 64)
+#define NNUE_L1 256
+#define NNUE_L2 32
+
+// Activations are clipped to [0, NNUE_CLIP]; hidden sums are scaled down
+// by 2^NNUE_L2_SHIFT, and the output by NNUE_OUTPUT_SCALE.
+#define NNUE_CLIP 127
+#define NNUE_L2_SHIFT 6
+#define NNUE_OUTPUT_SCALE 16
+
+#define NNUE_MAGIC "CHESTNN1"
+#define NNUE_VERSION 1
+#define NNUE_HEADER_SIZE 32
+
+struct nnueNetwork
+{
+    const int16_t *ft_biases;
+    const int16_t *ft_weights;
+    const int32_t *l2_biases;
+    const int8_t *l2_weights;
+    int32_t out_bias;
+    const int8_t *out_weights;
+
+    // The mapping the weights point into, to unmap when replaced
+    const void *mapping;
+    size_t mapping_size;
+};
+
+// The first layer's output for each perspective, with a flag for each
+// saying it is out of date and must be rebuilt before use.
+struct nnueAccumulator
+{
+    int16_t values[2][NNUE_L1] __attribute__((aligned(32)));
+    bool dirty[2];
+};
+
+// The loaded network, or NULL to evaluate without one.
+struct nnueNetwork *nnue_net = NULL;
+struct nnueNetwork nnue_storage;
+
+static inline size_t nnueFileSize()
+{
+    return NNUE_HEADER_SIZE
+        + sizeof(int16_t) * NNUE_L1
+        + sizeof(int16_t) * (size_t) NNUE_INPUTS * NNUE_L1
+        + sizeof(int32_t) * NNUE_L2
+        + sizeof(int8_t) * NNUE_L2 * 2 * NNUE_L1
+        + sizeof(int32_t)
+        + sizeof(int8_t) * NNUE_L2;
+}
+
+// Point net into data[0..size). Returns false if the data is not a
+// network of the expected shape.
+static bool nnueParse(struct nnueNetwork *net, const void *data, size_t size)
+{
+    const uint8_t *p = data;
+    uint32_t header[4];
+
+    if (size != nnueFileSize() || memcmp(p, NNUE_MAGIC, 8) != 0) { return false; }
+    memcpy(header, p + 8, sizeof(header));
+    if (header[0] != NNUE_VERSION || header[1] != NNUE_INPUTS
+            || header[2] != NNUE_L1 || header[3] != NNUE_L2)
+    {
+        return false;
+    }
+
+    // Every array starts at a multiple of its element size, so the
+    // weights can be used in place.
+    p += NNUE_HEADER_SIZE;
+    net->ft_biases = (const int16_t *) p;   p += sizeof(int16_t) * NNUE_L1;
+    net->ft_weights = (const int16_t *) p;  p += sizeof(int16_t) * (size_t) NNUE_INPUTS * NNUE_L1;
+    net->l2_biases = (const int32_t *) p;   p += sizeof(int32_t) * NNUE_L2;
+    net->l2_weights = (const int8_t *) p;   p += sizeof(int8_t) * NNUE_L2 * 2 * NNUE_L1;
+    memcpy(&net->out_bias, p, sizeof(int32_t)); p += sizeof(int32_t);
+    net->out_weights = (const int8_t *) p;
+
+    net->mapping = NULL;
+    net->mapping_size = 0;
+    return true;
+}
+
+void nnueUnload()
+{
+    if (nnue_net != NULL && nnue_net->mapping != NULL)
+    {
+        munmap((void *) nnue_net->mapping, nnue_net->mapping_size);
+    }
+    nnue_net = NULL;
+}
+
+// Replace the current network, unmapping its file if it has one.
+static void nnueUse(const struct nnueNetwork *net)
+{
+    nnueUnload();
+    nnue_storage = *net;
+    nnue_net = &nnue_storage;
+}
+
+/*
+ * Use the network in data[0..size), which must stay valid while it is in
+ * use. Returns false, leaving the current network in place, if the data
+ * is not a network of the expected shape.
+ */
+bool nnueLoadFromMemory(const void *data, size_t size)
+{
+    struct nnueNetwork net;
+    if (!nnueParse(&net, data, size)) { return false; }
+    nnueUse(&net);
+    return true;
+}
+
+// Map a network file into memory and use it. Returns false, leaving the
+// current network in place, on failure.
+bool nnueLoad(const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) { return false; }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size != nnueFileSize())
+    {
+        close(fd);
+        return false;
+    }
+
+    void *mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) { return false; }
+
+    struct nnueNetwork net;
+    if (!nnueParse(&net, mapping, st.st_size))
+    {
+        munmap(mapping, st.st_size);
+        return false;
+    }
+    net.mapping = mapping;
+    net.mapping_size = st.st_size;
+    nnueUse(&net);
+    return true;
+}
+
+/*
+ * The input index of a piece of the given color index and type (PAWN to
+ * QUEEN, 1-5) on sq, seen from perspective's side with its king on king_sq.
+ */
+static inline int nnueFeature(int perspective, int king_sq, int color_index, int type, int sq)
+{
+    // Seen from black's side, the board is upside down
+    int flip = (perspective == 0) ? 56 : 0;
+    int kind = (type - 1) + (color_index == perspective ? 0 : 5);
+    return ((king_sq ^ flip) * NNUE_PIECE_KINDS + kind) * 64 + (sq ^ flip);
+}
+
+// Add (sign 1) or remove (sign -1) one feature's weights.
+static inline void nnueUpdateFeature(int16_t *acc, int feature, int sign)
+{
+    const int16_t *w = &nnue_net->ft_weights[(size_t) feature * NNUE_L1];
+
+#if defined(__AVX2__)
+    for (int i = 0; i < NNUE_L1; i += 16)
+    {
+        __m256i a = _mm256_load_si256((const __m256i *) &acc[i]);
+        __m256i b = _mm256_loadu_si256((const __m256i *) &w[i]);
+        a = (sign > 0) ? _mm256_add_epi16(a, b) : _mm256_sub_epi16(a, b);
+        _mm256_store_si256((__m256i *) &acc[i], a);
+    }
+#elif defined(__SSE2__)
+    for (int i = 0; i < NNUE_L1; i += 8)
+    {
+        __m128i a = _mm_load_si128((const __m128i *) &acc[i]);
+        __m128i b = _mm_loadu_si128((const __m128i *) &w[i]);
+        a = (sign > 0) ? _mm_add_epi16(a, b) : _mm_sub_epi16(a, b);
+        _mm_store_si128((__m128i *) &acc[i], a);
+    }
+#else
+    for (int i = 0; i < NNUE_L1; i++)
+    {
+        acc[i] = (int16_t) (acc[i] + sign * w[i]);
+    }
+#endif
+}
+
+static inline void nnueResetAccumulator(int16_t *acc)
+{
+    memcpy(acc, nnue_net->ft_biases, sizeof(int16_t) * NNUE_L1);
+}
+
+static inline int nnueClamp(int x)
+{
+    return x < 0 ? 0 : (x > NNUE_CLIP ? NNUE_CLIP : x);
+}
+
+// Clip the accumulators for (us, them) to [0, NNUE_CLIP] as bytes.
+static inline void nnueClip(const int16_t *us, const int16_t *them, uint8_t *out)
+{
+    for (int half = 0; half < 2; half++)
+    {
+        const int16_t *acc = half ? them : us;
+        uint8_t *dst = out + half * NNUE_L1;
+#if defined(__AVX2__) || defined(__SSE2__)
+        for (int i = 0; i < NNUE_L1; i += 16)
+        {
+            __m128i a = _mm_load_si128((const __m128i *) &acc[i]);
+            __m128i b = _mm_load_si128((const __m128i *) &acc[i + 8]);
+            __m128i packed = _mm_min_epu8(_mm_packus_epi16(a, b), _mm_set1_epi8(NNUE_CLIP));
+            _mm_storeu_si128((__m128i *) &dst[i], packed);
+        }
+#else
+        for (int i = 0; i < NNUE_L1; i++)
+        {
+            dst[i] = (uint8_t) nnueClamp(acc[i]);
+        }
+#endif
+    }
+}
+
+// The dot product of n unsigned activations and signed weights.
+static inline int32_t nnueDot(const uint8_t *in, const int8_t *w, int n)
+{
+#if defined(__AVX2__)
+    __m256i sum = _mm256_setzero_si256();
+    for (int i = 0; i < n; i += 32)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i *) &in[i]);
+        __m256i b = _mm256_loadu_si256((const __m256i *) &w[i]);
+        // Activations are at most 127, so the pairwise 16-bit sums of
+        // maddubs cannot saturate.
+        __m256i products = _mm256_maddubs_epi16(a, b);
+        sum = _mm256_add_epi32(sum, _mm256_madd_epi16(products, _mm256_set1_epi16(1)));
+    }
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4e));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xb1));
+    return _mm_cvtsi128_si32(s);
+#elif defined(__SSE2__)
+    __m128i sum = _mm_setzero_si128();
+    __m128i zero = _mm_setzero_si128();
+    for (int i = 0; i < n; i += 16)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i *) &in[i]);
+        __m128i b = _mm_loadu_si128((const __m128i *) &w[i]);
+        // Widen to 16 bits: activations with zeros, weights with their sign
+        __m128i sign = _mm_cmpgt_epi8(zero, b);
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, sign)));
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, sign)));
+    }
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4e));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xb1));
+    return _mm_cvtsi128_si32(sum);
+#else
+    int32_t sum = 0;
+    for (int i = 0; i < n; i++)
+    {
+        sum += in[i] * w[i];
+    }
+    return sum;
+#endif
+}
+
+/*
+ * Run the layers after the accumulators. us is the side to move's
+ * accumulator; the score is from its point of view, in centipawns.
+ */
+int nnueOutput(const int16_t *us, const int16_t *them)
+{
+    uint8_t input[2 * NNUE_L1] __attribute__((aligned(32)));
+    nnueClip(us, them, input);
+
+    int32_t out = nnue_net->out_bias;
+    for (int j = 0; j < NNUE_L2; j++)
+    {
+        int32_t sum = nnue_net->l2_biases[j]
+            + nnueDot(input, &nnue_net->l2_weights[j * 2 * NNUE_L1], 2 * NNUE_L1);
+        int hidden = nnueClamp(sum >> NNUE_L2_SHIFT);
+        out += hidden * nnue_net->out_weights[j];
+    }
+
+    return out / NNUE_OUTPUT_SCALE;
+}
+
+#endif // NNUE_H
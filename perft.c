@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "board.h"
+#include "moves.h"
+#include "perft.h"
+#include "timeman.h"
+
+/*
+ * Perft from the command line, to compare the move generator with other
+ * engines when hunting a bug and to measure its speed. Prints the count
+ * below each move ("divide"), then the total, the time taken and the speed.
+ * To narrow down a difference, add the move whose count is wrong to the
+ * move list and run again one ply shallower.
+ *
+ * Usage: ./chest-perft [-t threads] [-H hash MB] depth [FEN [move...]]
+ *
+ * The FEN defaults to the starting position. Moves are in coordinate
+ * notation ("e2e4") and are played from the FEN before counting.
+ */
+
+#define START_FEN "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"
+#define DEFAULT_HASH_MB 64
+// The perft table keeps depths in 8 bits
+#define MAX_PERFT_DEPTH 255
+
+void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [-t threads] [-H hash MB] depth [FEN [move...]]\n", name);
+}
+
+int main(int argc, char **argv)
+{
+    int n_threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    int hash_mb = DEFAULT_HASH_MB;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "t:H:")) != -1)
+    {
+        switch (opt)
+        {
+            case 't': n_threads = atoi(optarg); break;
+            case 'H': hash_mb = atoi(optarg); break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+
+    if (optind >= argc)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    char *end;
+    long depth = strtol(argv[optind], &end, 10);
+    if (end == argv[optind] || *end != '\0' || depth < 0 || depth > MAX_PERFT_DEPTH)
+    {
+        fprintf(stderr, "Invalid depth: %s\n", argv[optind]);
+        usage(argv[0]);
+        return 1;
+    }
+    optind++;
+    const char *fen = (optind < argc) ? argv[optind++] : START_FEN;
+
+    struct board b;
+    init_board(&b);
+    apply_FEN(&b, fen);
+
+    // apply_FEN does not validate; without both kings, move generation would crash
+    if (b.king_sq[0] < 0 || b.king_sq[1] < 0)
+    {
+        fprintf(stderr, "Invalid FEN: %s\n", fen);
+        return 1;
+    }
+
+    for (; optind < argc; optind++)
+    {
+        struct move m;
+        if (!parseMove(&b, argv[optind], &m))
+        {
+            fprintf(stderr, "Illegal move: %s\n", argv[optind]);
+            return 1;
+        }
+        applyMove(&b, m);
+    }
+
+    initPerftTable(hash_mb);
+
+    double start = monotonicSeconds();
+    long long int nodes = parallelPerft(&b, depth, n_threads, true);
+    double seconds = monotonicSeconds() - start;
+
+    printf("\nNodes: %lld\n", nodes);
+    printf("Time: %.3f s\n", seconds);
+    printf("Speed: %.2f Mnps\n", seconds > 0 ? nodes / seconds / 1e6 : 0);
+    return 0;
+}
@@ -0,0 +1,245 @@
+#ifndef PERFT_H
+#define PERFT_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "board.h"
+#include "moves.h"
+
+/*
+ * Perft: count every leaf of the legal move tree to a fixed depth, to check
+ * the move generator against known counts and to measure its speed.
+ * https://www.chessprogramming.org/Perft
+ */
+
+/*
+ * Perft counts already worked out, keyed on the position's hash and the
+ * remaining depth, so that a subtree reached by transposition is only
+ * walked once. Each slot keeps the most recent result stored in it.
+ *
+ * The table is shared between threads without locks: the count and depth
+ * are packed into one word, and the key is stored XORed with that word,
+ * so a slot torn by two threads writing at once fails the key check
+ * instead of returning a wrong count.
+ * https://www.chessprogramming.org/Shared_Hash_Table#Lockless
+ */
+struct perftEntry
+{
+    uint64_t key;
+    uint64_t data;
+};
+
+struct perftEntry *perft_table = NULL;
+uint64_t perft_table_mask = 0;
+
+/*
+ * (Re)allocate the perft hash table at the largest power-of-two number of
+ * entries that fits in size_mb megabytes. Zero disables it.
+ */
+void initPerftTable(int size_mb)
+{
+    free(perft_table);
+    perft_table = NULL;
+    perft_table_mask = 0;
+
+    if (size_mb <= 0) { return; }
+
+    size_t n_entries = 1;
+    while (n_entries * 2 * sizeof(struct perftEntry) <= (size_t) size_mb << 20)
+    {
+        n_entries *= 2;
+    }
+
+    perft_table = calloc(n_entries, sizeof(struct perftEntry));
+    if (perft_table == NULL)
+    {
+        fprintf(stderr, "Could not allocate %d MB perft hash table\n", size_mb);
+        return;
+    }
+    perft_table_mask = n_entries - 1;
+}
+
+static inline struct perftEntry *perftSlot(uint64_t hash, int depth)
+{
+    // Spread the same position at different depths over different slots
+    return &perft_table[(hash ^ (depth * 0x9e3779b97f4a7c15ULL)) & perft_table_mask];
+}
+
+/*
+ * Count the leaf nodes `depth` plies below b. With print set, also print
+ * the count below each root move ("divide").
+ */
+long long int perft(struct board *b, int depth, bool print)
+{
+    long long int nodes = 0;
+
+    if (depth == 0) { return 1; }
+
+    struct perftEntry *entry = NULL;
+    if (perft_table != NULL && depth > 1 && !print)
+    {
+        entry = perftSlot(b->hash, depth);
+        uint64_t key = __atomic_load_n(&entry->key, __ATOMIC_RELAXED);
+        uint64_t data = __atomic_load_n(&entry->data, __ATOMIC_RELAXED);
+        if ((key ^ data) == b->hash && (int) (data & 0xff) == depth)
+        {
+            return (long long int) (data >> 8);
+        }
+    }
+
+    struct moveList ml;
+    init_movelist(&ml);
+    genAllMoves(b, &ml);
+
+    if (depth == 1 && !print) { return ml.n_moves; }
+
+    for (int i = 0; i < ml.n_moves; i++)
+    {
+        struct undo u = applyMove(b, ml.moves[i]);
+        long long int responses = perft(b, depth-1, false);
+        undoMove(b, ml.moves[i], u);
+
+        if (print)
+        {
+            char move_str[6];
+            moveString(ml.moves[i], move_str);
+            printf("%s", move_str);
+            printf(": %lld\n", responses);
+        }
+
+        nodes += responses;
+    }
+
+    if (entry != NULL)
+    {
+        uint64_t data = ((uint64_t) nodes << 8) | depth;
+        __atomic_store_n(&entry->key, b->hash ^ data, __ATOMIC_RELAXED);
+        __atomic_store_n(&entry->data, data, __ATOMIC_RELAXED);
+    }
+
+    return nodes;
+}
+
+/*
+ * Parallel perft. The tree is split two plies down: every (root move,
+ * reply) pair is one job, and worker threads take jobs from a shared
+ * counter until none are left. That gives enough small jobs to keep all
+ * threads busy even when one root move has a much bigger subtree than
+ * the rest. Each worker walks its own copy of the board; they share the
+ * perft hash table.
+ */
+struct perftJob
+{
+    struct move root_move;
+    struct move reply;
+    int i_root;
+};
+
+struct perftWork
+{
+    const struct board *root;
+    int depth;
+    struct perftJob *jobs;
+    int n_jobs;
+    int next_job;
+    long long int *root_counts;
+};
+
+void *perftWorker(void *arg)
+{
+    struct perftWork *work = arg;
+    struct board b = *work->root;
+
+    while (true)
+    {
+        int i_job = __atomic_fetch_add(&work->next_job, 1, __ATOMIC_RELAXED);
+        if (i_job >= work->n_jobs) { break; }
+
+        struct perftJob *job = &work->jobs[i_job];
+        struct undo u_root = applyMove(&b, job->root_move);
+        struct undo u_reply = applyMove(&b, job->reply);
+        long long int nodes = perft(&b, work->depth - 2, false);
+        undoMove(&b, job->reply, u_reply);
+        undoMove(&b, job->root_move, u_root);
+
+        __atomic_fetch_add(&work->root_counts[job->i_root], nodes, __ATOMIC_RELAXED);
+    }
+
+    return NULL;
+}
+
+/*
+ * Count the leaf nodes `depth` plies below b using n_threads threads. With
+ * print set, also print the count below each root move ("divide").
+ */
+long long int parallelPerft(struct board *b, int depth, int n_threads, bool print)
+{
+    if (n_threads <= 1 || depth < 3)
+    {
+        return perft(b, depth, print);
+    }
+
+    struct moveList root_moves;
+    init_movelist(&root_moves);
+    genAllMoves(b, &root_moves);
+
+    struct perftWork work = {
+        .root = b,
+        .depth = depth,
+        .jobs = malloc(sizeof(struct perftJob) * MAX_MOVES * root_moves.n_moves),
+        .n_jobs = 0,
+        .next_job = 0,
+        .root_counts = calloc(root_moves.n_moves, sizeof(long long int))
+    };
+
+    for (int i = 0; i < root_moves.n_moves; i++)
+    {
+        struct undo u = applyMove(b, root_moves.moves[i]);
+
+        struct moveList replies;
+        init_movelist(&replies);
+        genAllMoves(b, &replies);
+        for (int j = 0; j < replies.n_moves; j++)
+        {
+            work.jobs[work.n_jobs++] = (struct perftJob) {
+                .root_move = root_moves.moves[i],
+                .reply = replies.moves[j],
+                .i_root = i
+            };
+        }
+
+        undoMove(b, root_moves.moves[i], u);
+    }
+
+    pthread_t *threads = malloc(sizeof(pthread_t) * n_threads);
+    for (int i = 0; i < n_threads; i++)
+    {
+        pthread_create(&threads[i], NULL, perftWorker, &work);
+    }
+    for (int i = 0; i < n_threads; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    long long int nodes = 0;
+    for (int i = 0; i < root_moves.n_moves; i++)
+    {
+        if (print)
+        {
+            char move_str[6];
+            moveString(root_moves.moves[i], move_str);
+            printf("%s: %lld\n", move_str, work.root_counts[i]);
+        }
+        nodes += work.root_counts[i];
+    }
+
+    free(threads);
+    free(work.jobs);
+    free(work.root_counts);
+    return nodes;
+}
+
+#endif // PERFT_H
@@ -0,0 +1,167 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Counters showing where a search spends its nodes, for tuning: how often
+ * the transposition table and the pruning techniques pay off, and how
+ * fast the tree grows from one iteration to the next.
+ *
+ * Each search thread counts into its own copy; the search sums them. The
+ * counting is compiled out by building with -DNO_SEARCH_STATS, leaving only
+ * the node counts and per-iteration figures, which cost nothing per node.
+ */
+
+// Iterations tracked per search (see MAX_SEARCH_DEPTH in ai.h)
+#define STATS_MAX_DEPTH 64
+
+struct searchStats
+{
+    // All nodes, and how many of those were in quiescence search. The
+    // node count is kept even without the other counters, for the limits.
+    long long int nodes;
+    long long int qnodes;
+
+    // Static evaluations
+    long long int evals;
+
+    // Transposition table lookups, how many found the position, and how
+    // many of those ended the search of the node
+    long long int tt_probes;
+    long long int tt_hits;
+    long long int tt_cutoffs;
+
+    // Beta cutoffs, and how many came from the first move searched: the
+    // higher the share, the better the move ordering
+    long long int fail_highs;
+    long long int fail_highs_first;
+
+    // Null-move searches, and how many failed high
+    long long int null_tries;
+    long long int null_cutoffs;
+
+    // Reduced searches, and how many held (did not need a re-search)
+    long long int lmr_tries;
+    long long int lmr_successes;
+
+    // For each completed iteration: the nodes it took, and the total time
+    // taken when it completed
+    int depth;
+    long long int depth_nodes[STATS_MAX_DEPTH + 1];
+    double depth_seconds[STATS_MAX_DEPTH + 1];
+};
+
+#ifdef NO_SEARCH_STATS
+#define STAT_INC(stats, counter) ((void) 0)
+#else
+#define STAT_INC(stats, counter) ((stats)->counter++)
+#endif
+
+void clearStats(struct searchStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+// Zero the counters, keeping the per-iteration figures.
+void clearCounters(struct searchStats *stats)
+{
+    memset(stats, 0, offsetof(struct searchStats, depth));
+}
+
+// Add one thread's counters into a total. The per-iteration figures are
+// not added: only the main thread records those.
+void addStats(struct searchStats *total, const struct searchStats *stats)
+{
+    total->nodes += stats->nodes;
+    total->qnodes += stats->qnodes;
+    total->evals += stats->evals;
+    total->tt_probes += stats->tt_probes;
+    total->tt_hits += stats->tt_hits;
+    total->tt_cutoffs += stats->tt_cutoffs;
+    total->fail_highs += stats->fail_highs;
+    total->fail_highs_first += stats->fail_highs_first;
+    total->null_tries += stats->null_tries;
+    total->null_cutoffs += stats->null_cutoffs;
+    total->lmr_tries += stats->lmr_tries;
+    total->lmr_successes += stats->lmr_successes;
+}
+
+// Record that the iteration at depth completed, nodes and seconds into the search.
+void recordIteration(struct searchStats *stats, int depth, long long int nodes, double seconds)
+{
+    if (depth > STATS_MAX_DEPTH) { return; }
+
+    long long int previous_total = 0;
+    for (int d = 1; d < depth; d++)
+    {
+        previous_total += stats->depth_nodes[d];
+    }
+
+    stats->depth = depth;
+    stats->depth_nodes[depth] = nodes - previous_total;
+    stats->depth_seconds[depth] = seconds;
+}
+
+/*
+ * Effective branching factor: how many times more nodes the iteration at
+ * depth took than the one before it. 0 if either is unknown.
+ * https://www.chessprogramming.org/Branching_Factor
+ */
+double effectiveBranchingFactor(const struct searchStats *stats, int depth)
+{
+    if (depth < 2 || depth > STATS_MAX_DEPTH || stats->depth_nodes[depth - 1] == 0)
+    {
+        return 0;
+    }
+    return (double) stats->depth_nodes[depth] / stats->depth_nodes[depth - 1];
+}
+
+static inline double percentage(long long int part, long long int whole)
+{
+    return whole > 0 ? 100.0 * part / whole : 0;
+}
+
+// One human-readable line about the search up to the last completed iteration.
+void printStats(FILE *f, const struct searchStats *stats)
+{
+    int d = stats->depth;
+    double seconds = stats->depth_seconds[d];
+
+    fprintf(f, "depth %2d  %6.2fs  nodes %lld  %.0f knps  ebf %.2f\n",
+            d, seconds, stats->nodes, seconds > 0 ? stats->nodes / seconds / 1000 : 0,
+            effectiveBranchingFactor(stats, d));
+#ifndef NO_SEARCH_STATS
+    fprintf(f, "          quiescence %.0f%%  tt hits %.0f%% cutoffs %.0f%%  first-move fail highs %.0f%%"
+            "  null cutoffs %.0f%%  lmr held %.0f%%\n",
+            percentage(stats->qnodes, stats->nodes),
+            percentage(stats->tt_hits, stats->tt_probes),
+            percentage(stats->tt_cutoffs, stats->tt_probes),
+            percentage(stats->fail_highs_first, stats->fail_highs),
+            percentage(stats->null_cutoffs, stats->null_tries),
+            percentage(stats->lmr_successes, stats->lmr_tries));
+#endif
+}
+
+// The same as one line of JSON, with the raw counts.
+void printStatsJSON(FILE *f, const struct searchStats *stats)
+{
+    int d = stats->depth;
+
+    fprintf(f, "{\"depth\":%d,\"seconds\":%.6f,\"nodes\":%lld,\"qnodes\":%lld,"
+            "\"depth_nodes\":%lld,\"ebf\":%.4f,\"evals\":%lld,"
+            "\"tt_probes\":%lld,\"tt_hits\":%lld,\"tt_cutoffs\":%lld,"
+            "\"fail_highs\":%lld,\"fail_highs_first\":%lld,"
+            "\"null_tries\":%lld,\"null_cutoffs\":%lld,"
+            "\"lmr_tries\":%lld,\"lmr_successes\":%lld}\n",
+            d, stats->depth_seconds[d], stats->nodes, stats->qnodes,
+            stats->depth_nodes[d], effectiveBranchingFactor(stats, d), stats->evals,
+            stats->tt_probes, stats->tt_hits, stats->tt_cutoffs,
+            stats->fail_highs, stats->fail_highs_first,
+            stats->null_tries, stats->null_cutoffs,
+            stats->lmr_tries, stats->lmr_successes);
+}
+
+#endif // STATS_H
@@ -1,99 +1,450 @@
+#include <pthread.h>
 #include <stdio.h>
-#include <time.h>
+#include <stdlib.h>
+#include <unistd.h>
 
 #include "board.h"
 #include "moves.h"
-
-#define MAX_PERFT_DEPTH 4
+#include "eval.h"
+#include "evalbatch.h"
+#include "nnue.h"
+#include "perft.h"
+#include "ai.h"
+#include "timeman.h"
+
+// Defaults; all can be overridden on the command line:
+//   ./test [max depth] [perft hash size in MB] [threads]
+// By default, one thread runs per online CPU.
+#define MAX_PERFT_DEPTH 5
+#define PERFT_HASH_MB 64
 
 int num_tests;
 int num_success;
+int max_perft_depth = MAX_PERFT_DEPTH;
+int perft_threads = 1;
 
-long long int perft(const struct board *b, int depth, bool print)
+struct PerftTest
 {
-    long long int nodes = 0;
+    const char *start_pos;
+    int max_depth;
+    long long int expected[16];
+};
 
-    if (depth == 0) { return 1; }
+bool runPerftTest(struct PerftTest *test)
+{
+    num_tests++;
 
-    struct moveList ml;
-    init_movelist(&ml);
-    genAllMoves(b, &ml);
+    printf("Perft test on %s\n", test->start_pos);
+    struct board b;
+    init_board(&b);
+    apply_FEN(&b, test->start_pos);
 
-    if (depth == 1) { return ml.n_moves; }
+    int max_depth = MIN(test->max_depth, max_perft_depth);
+    struct board original = b;
 
-    for (int i = 0; i < ml.n_moves; i++)
+    for (int depth = 1; depth <= max_depth; depth++)
     {
-        struct board b2 = *b;
-        applyMove(&b2, ml.moves[i]);
-
-        long long int responses = perft(&b2, depth-1, false);
-        if (print)
+        long long int perft_result = parallelPerft(&b, depth, perft_threads, false);
+        if (perft_result == test->expected[depth])
         {
-            struct move m = ml.moves[i];
-            printf("%c%c%c%c",
-                    m.from.file + 'a',
-                    m.from.rank + '1',
-                    m.to.file + 'a',
-                    m.to.rank + '1');
-            switch (m.promotion)
-            {
-                case QUEEN:     putc('q', stdout); break;
-                case BISHOP:    putc('b', stdout); break;
-                case KNIGHT:    putc('n', stdout); break;
-                case ROOK:      putc('r', stdout); break;
-            }
-            printf(": %lld\n", responses);
+            printf("  depth %d OK - %lld\n", depth, perft_result);
+        }
+        else
+        {
+            fprintf(stderr, "  depth %d: expected %lld, got %lld\n",
+                    depth, test->expected[depth], perft_result);
+            return false;
         }
 
-        nodes += responses;
+        // perft walks the tree in place, so every undoMove has to restore
+        // the board exactly.
+        if (!boardsEqual(&b, &original))
+        {
+            fprintf(stderr, "  depth %d: board not restored after perft\n", depth);
+            return false;
+        }
     }
 
-    return nodes;
+    num_success++;
+    return true;
 }
 
-struct PerftTest
+struct HashTest
 {
     const char *start_pos;
-    int max_depth;
-    long long int expected[16];
+    const char *moves;
+    const char *expected_pos;
 };
 
-bool runPerftTest(struct PerftTest *test)
+/*
+ * The incrementally updated hash after a sequence of moves must match the
+ * hash of the resulting position set up from scratch.
+ */
+bool runHashTest(struct HashTest *test)
 {
     num_tests++;
 
-    printf("Perft test on %s\n", test->start_pos);
+    printf("Hash test: %s\n", test->moves);
     struct board b;
     init_board(&b);
     apply_FEN(&b, test->start_pos);
 
-    int max_depth = MIN(test->max_depth, MAX_PERFT_DEPTH);
+    struct board expected;
+    init_board(&expected);
+    apply_FEN(&expected, test->expected_pos);
 
-    for (int depth = 1; depth <= max_depth; depth++)
+    if (!applyMoveStrings(&b, test->moves))
     {
-        long long int perft_result = perft(&b, depth, false);
-        if (perft_result == test->expected[depth])
+        fprintf(stderr, "  could not apply moves\n");
+        return false;
+    }
+
+    if (b.hash != computeHash(&b) || !boardsEqual(&b, &expected))
+    {
+        fprintf(stderr, "  hash %016llx, expected %016llx\n",
+                (unsigned long long) b.hash, (unsigned long long) expected.hash);
+        return false;
+    }
+
+    printf("  OK - %016llx\n", (unsigned long long) b.hash);
+    num_success++;
+    return true;
+}
+
+/*
+ * Batch evaluation must give exactly the scores evaluate() does, one
+ * position at a time, with every kernel the CPU supports.
+ */
+bool runBatchEvalTest(const char **fens, int n_fens)
+{
+    num_tests++;
+    printf("Batch evaluation test\n");
+
+    // Repeat the positions so that the vector kernels see a partial block
+    int n_positions = 3 * n_fens + 1;
+    struct positionBatch batch;
+    initBatch(&batch, n_positions);
+    int *expected = malloc(sizeof(int) * n_positions);
+    int *scores = malloc(sizeof(int) * n_positions);
+
+    for (int i = 0; i < n_positions; i++)
+    {
+        struct board b;
+        init_board(&b);
+        apply_FEN(&b, fens[i % n_fens]);
+        addToBatch(&batch, &b);
+        expected[i] = evaluate(&b);
+    }
+
+    bool ok = true;
+    int n_kernels = 0;
+    for (int k = 0; k < N_BATCH_KERNELS; k++)
+    {
+        const struct batchKernel *kernel = &batch_kernels[k];
+        if (!batchKernelSupported(kernel)) { continue; }
+        n_kernels++;
+
+        kernel->evaluate(&batch, scores);
+        for (int i = 0; i < n_positions; i++)
         {
-            printf("  depth %d OK - %lld\n", depth, perft_result);
+            if (scores[i] != expected[i])
+            {
+                fprintf(stderr, "  %s: %s kernel %d, expected %d\n",
+                        fens[i % n_fens], kernel->name, scores[i], expected[i]);
+                ok = false;
+            }
         }
-        else
+    }
+
+    freeBatch(&batch);
+    free(expected);
+    free(scores);
+
+    if (!ok) { return false; }
+    printf("  OK - %d positions, %d kernels\n", n_positions, n_kernels);
+    num_success++;
+    return true;
+}
+
+// Fill a network file image with small random weights.
+void *randomNetwork(uint64_t seed)
+{
+    size_t size = nnueFileSize();
+    uint8_t *data = malloc(size);
+    uint32_t header[6] = { NNUE_VERSION, NNUE_INPUTS, NNUE_L1, NNUE_L2, 0, 0 };
+    memcpy(data, NNUE_MAGIC, 8);
+    memcpy(data + 8, header, sizeof(header));
+
+    // Small enough that the activations are spread out rather than clipped
+    size_t n_ft = NNUE_L1 + (size_t) NNUE_INPUTS * NNUE_L1;
+    int16_t *ft = (int16_t *) (data + NNUE_HEADER_SIZE);
+    for (size_t i = 0; i < n_ft; i++)
+    {
+        ft[i] = (int16_t) (random64(&seed) % 17) - 8;
+    }
+    int32_t *l2_biases = (int32_t *) (ft + n_ft);
+    for (int i = 0; i < NNUE_L2; i++)
+    {
+        l2_biases[i] = (int32_t) (random64(&seed) % 2001) - 1000;
+    }
+    int8_t *l2_weights = (int8_t *) (l2_biases + NNUE_L2);
+    for (int i = 0; i < NNUE_L2 * 2 * NNUE_L1; i++)
+    {
+        l2_weights[i] = (int8_t) (random64(&seed) % 33) - 16;
+    }
+    int8_t *out = l2_weights + NNUE_L2 * 2 * NNUE_L1;
+    memset(out, 0, sizeof(int32_t));
+    for (int i = 0; i < NNUE_L2; i++)
+    {
+        out[sizeof(int32_t) + i] = (int8_t) (random64(&seed) % 33) - 16;
+    }
+    return data;
+}
+
+/*
+ * With a network loaded, the accumulators kept up to date by applyMove and
+ * undoMove must always match ones rebuilt from scratch. Plays random moves
+ * from each position, checking after every move and every undo.
+ */
+bool runNNUETest(const char **fens, int n_fens, int n_plies)
+{
+    num_tests++;
+    printf("NNUE accumulator test\n");
+
+    void *net = randomNetwork(0x2545f4914f6cdd1dULL);
+    if (!nnueLoadFromMemory(net, nnueFileSize()))
+    {
+        fprintf(stderr, "  could not load network\n");
+        free(net);
+        return false;
+    }
+
+    // A network that fails to load, here a file of the right size with the
+    // wrong magic, must leave the current one in place
+    const int16_t *ft_biases = nnue_net->ft_biases;
+    char path[] = "/tmp/chest-nnue-XXXXXX";
+    int fd = mkstemp(path);
+    bool kept = false;
+    if (fd >= 0)
+    {
+        void *bad = randomNetwork(1);
+        memcpy(bad, "NOTANNUE", 8);
+        kept = write(fd, bad, nnueFileSize()) == (ssize_t) nnueFileSize()
+            && !nnueLoad(path) && nnue_net != NULL && nnue_net->ft_biases == ft_biases;
+        free(bad);
+        close(fd);
+        unlink(path);
+    }
+    if (!kept)
+    {
+        fprintf(stderr, "  a failed load did not keep the network\n");
+        nnueUnload();
+        free(net);
+        return false;
+    }
+
+    uint64_t seed = 0x9e3779b97f4a7c15ULL;
+    int n_checks = 0;
+    bool ok = true;
+
+    for (int i = 0; i < n_fens && ok; i++)
+    {
+        struct board b;
+        init_board(&b);
+        apply_FEN(&b, fens[i]);
+        evaluate(&b);
+
+        for (int ply = 0; ply < n_plies && ok; ply++)
         {
-            fprintf(stderr, "  depth %d: expected %lld, got %lld\n",
-                    depth, test->expected[depth], perft_result);
+            struct moveList ml;
+            init_movelist(&ml);
+            genAllMoves(&b, &ml);
+            if (ml.n_moves == 0) { break; }
+            struct move m = ml.moves[random64(&seed) % ml.n_moves];
+            struct undo u;
+
+            for (int step = 0; step < 3 && ok; step++)
+            {
+                // Apply, undo, then apply again to move on
+                if (step == 1) { undoMove(&b, m, u); }
+                else { u = applyMove(&b, m); }
+
+                struct board fresh = b;
+                int score = evaluate(&b);
+                refreshAccumulator(&fresh, 0);
+                refreshAccumulator(&fresh, 1);
+
+                if (memcmp(b.accumulator.values, fresh.accumulator.values,
+                            sizeof(b.accumulator.values)) != 0
+                        || score != evaluate(&fresh))
+                {
+                    char move_str[6];
+                    moveString(m, move_str);
+                    fprintf(stderr, "  %s: accumulators differ after %s %s\n",
+                            fens[i], step == 1 ? "undoing" : "applying", move_str);
+                    ok = false;
+                }
+                n_checks++;
+            }
+        }
+    }
+
+    nnueUnload();
+    free(net);
+
+    if (!ok) { return false; }
+    printf("  OK - %d positions\n", n_checks);
+    num_success++;
+    return true;
+}
+
+/*
+ * Search with a network loaded on several threads. Each thread's board
+ * holds its own accumulators, which the vector kernels need aligned, and
+ * each search must still come back with a legal move.
+ */
+bool runNNUESearchTest(const char **fens, int n_fens, int n_threads, int depth)
+{
+    num_tests++;
+    printf("NNUE search test\n");
+
+    void *net = randomNetwork(0x2545f4914f6cdd1dULL);
+    if (!nnueLoadFromMemory(net, nnueFileSize()))
+    {
+        fprintf(stderr, "  could not load network\n");
+        free(net);
+        return false;
+    }
+    setThreads(n_threads);
+
+    bool ok = true;
+    for (int i = 0; i < n_search_threads && ok; i++)
+    {
+        if ((uintptr_t) &search_threads[i].b.accumulator % _Alignof(struct nnueAccumulator) != 0)
+        {
+            fprintf(stderr, "  thread %d: accumulator is misaligned\n", i);
+            ok = false;
+        }
+    }
+
+    for (int i = 0; i < n_fens && ok; i++)
+    {
+        struct board b;
+        init_board(&b);
+        apply_FEN(&b, fens[i]);
+
+        struct searchLimits limits = { .depth = depth };
+        prepareSearch(&limits);
+        struct move m = searchPosition(&b, &limits);
+
+        struct moveList ml;
+        init_movelist(&ml);
+        genAllMoves(&b, &ml);
+        bool legal = false;
+        for (int j = 0; j < ml.n_moves; j++)
+        {
+            legal |= movesEqual(&ml.moves[j], &m);
+        }
+        if (ml.n_moves > 0 && !legal)
+        {
+            fprintf(stderr, "  %s: no legal move returned\n", fens[i]);
+            ok = false;
+        }
+    }
+
+    setThreads(1);
+    nnueUnload();
+    free(net);
+
+    if (!ok) { return false; }
+    printf("  OK - %d positions on %d threads\n", n_fens, n_threads);
+    num_success++;
+    return true;
+}
+
+struct searchJob
+{
+    struct board b;
+    struct searchLimits limits;
+    bool done;
+};
+
+void *searchJobMain(void *arg)
+{
+    struct searchJob *job = arg;
+    searchPosition(&job->b, &job->limits);
+    __atomic_store_n(&job->done, true, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+// Seconds a stopped search may take to return before the test gives up on it
+#define STOP_TIMEOUT 5.0
+
+/*
+ * A "stop" or "ponderhit" sent right after "go", before the search thread
+ * has got going, must not be lost. Starts searches back to back the way
+ * chest-uci does: infinite ones followed at once by requestStop(), and
+ * ponder ones with a short move time followed at once by ponderHit().
+ * A search that has not returned after STOP_TIMEOUT fails the test (and
+ * is then stopped for good, so the test cannot hang).
+ */
+bool runStopTest(const char *fen, int n_rounds)
+{
+    num_tests++;
+    printf("Search stop test\n");
+
+    struct searchJob job;
+    init_board(&job.b);
+    apply_FEN(&job.b, fen);
+
+    for (int round = 0; round < n_rounds; round++)
+    {
+        bool ponder = round % 2;
+        job.limits = (struct searchLimits) { .infinite = !ponder, .ponder = ponder, .move_time = 0.05 };
+        job.done = false;
+
+        pthread_t thread;
+        prepareSearch(&job.limits);
+        pthread_create(&thread, NULL, searchJobMain, &job);
+        if (ponder) { ponderHit(); }
+        else { requestStop(); }
+
+        double start = monotonicSeconds();
+        while (!__atomic_load_n(&job.done, __ATOMIC_RELAXED) && monotonicSeconds() - start < STOP_TIMEOUT)
+        {
+            usleep(1000);
+        }
+
+        bool done = __atomic_load_n(&job.done, __ATOMIC_RELAXED);
+        if (!done)
+        {
+            requestStop();
+        }
+        pthread_join(thread, NULL);
+
+        if (!done)
+        {
+            fprintf(stderr, "  round %d: %s was lost\n", round, ponder ? "ponderhit" : "stop");
             return false;
         }
     }
 
+    printf("  OK - %d searches\n", n_rounds);
     num_success++;
     return true;
 }
 
-int main()
+int main(int argc, char **argv)
 {
-    clock_t start = clock();
+    double start = monotonicSeconds();
     num_tests = 0;
     num_success = 0;
 
+    if (argc > 1) { max_perft_depth = atoi(argv[1]); }
+    initPerftTable(argc > 2 ? atoi(argv[2]) : PERFT_HASH_MB);
+    perft_threads = (argc > 3) ? atoi(argv[3]) : (int) sysconf(_SC_NPROCESSORS_ONLN);
+    printf("Running perft with %d thread(s)\n", perft_threads);
+
     // Perft positions and results from:
     // https://www.chessprogramming.org/Perft_Results
 
@@ -216,8 +567,58 @@ int main()
 
     runPerftTest(&perft_test_6);
 
-    clock_t stop = clock();
-    double duration = (double) (stop - start) / CLOCKS_PER_SEC;
+    // Transpositions, castling and en passant must all hash the same way
+    // whether reached by moves or set up from FEN.
+    struct HashTest hash_tests[] = {
+        {
+            "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+            "g1f3 g8f6 b1c3",
+            "rnbqkb1r/pppppppp/5n2/8/8/2N2N2/PPPPPPPP/R1BQKB1R b KQkq - 3 2"
+        },
+        {
+            "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+            "b1c3 g8f6 g1f3",
+            "rnbqkb1r/pppppppp/5n2/8/8/2N2N2/PPPPPPPP/R1BQKB1R b KQkq - 3 2"
+        },
+        {
+            "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+            "e2e4",
+            "rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1"
+        },
+        {
+            "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+            "e1g1 b4c3 a2a4 e8c8",
+            "2kr3r/p1ppqpb1/bn2pnp1/3PN3/P3P3/2p2Q1p/1PPBBPPP/R4RK1 w - - 0 3"
+        },
+        {
+            "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+            "e2e4 a7a6 e4e5 d7d5 e5d6",
+            "rnbqkbnr/1pp1pppp/p2P4/8/8/8/PPPP1PPP/RNBQKBNR b KQkq - 0 3"
+        },
+    };
+
+    for (size_t i = 0; i < sizeof(hash_tests) / sizeof(hash_tests[0]); i++)
+    {
+        runHashTest(&hash_tests[i]);
+    }
+
+    const char *eval_positions[] = {
+        perft_test_1.start_pos,
+        perft_test_2.start_pos,
+        perft_test_3.start_pos,
+        perft_test_4.start_pos,
+        perft_test_4m.start_pos,
+        perft_test_5.start_pos,
+        perft_test_6.start_pos,
+    };
+    runBatchEvalTest(eval_positions, sizeof(eval_positions) / sizeof(eval_positions[0]));
+    runNNUETest(eval_positions, sizeof(eval_positions) / sizeof(eval_positions[0]), 100);
+
+    initComputer();
+    runNNUESearchTest(eval_positions, sizeof(eval_positions) / sizeof(eval_positions[0]), 3, 4);
+    runStopTest(perft_test_2.start_pos, 40);
+
+    double duration = monotonicSeconds() - start;
 
     printf("\nPassed %d of %d tests in %f seconds\n",
             num_success, num_tests, duration);
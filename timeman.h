@@ -0,0 +1,94 @@
+#ifndef TIMEMAN_H
+#define TIMEMAN_H
+
+#include <math.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "board.h"
+
+/*
+ * What a search is allowed to spend. Zero means "no limit" for every field;
+ * with no limits at all the search runs until it is told to stop.
+ */
+struct searchLimits
+{
+    int depth;
+    long long int nodes;
+
+    // Seconds for this move, regardless of the clock
+    double move_time;
+
+    // The mover's remaining game time and increment, in seconds
+    double time_left;
+    double increment;
+    int moves_to_go;
+
+    // Keep searching until stopped, even once a limit would have stopped it
+    bool infinite;
+
+    // Search the opponent's time as if infinite, until ponderHit() says the
+    // expected move was played; from then on the other limits apply.
+    bool ponder;
+};
+
+// Wall-clock time in seconds, unaffected by how many threads are running
+// or whether the process gets descheduled.
+double monotonicSeconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Two time limits per move. Past the soft limit, no new iteration is
+ * started, since it probably would not finish. Past the hard limit, the
+ * search is aborted wherever it is.
+ * https://www.chessprogramming.org/Time_Management
+ */
+struct timeManager
+{
+    double start;
+    double soft;
+    double hard;
+};
+
+// Seconds kept back from every move to cover the time taken to reply
+#define MOVE_OVERHEAD 0.05
+
+// Assumed number of moves left in the game, if the limits don't say
+#define DEFAULT_MOVES_TO_GO 30
+
+void initTimeManager(struct timeManager *tm, const struct searchLimits *limits)
+{
+    tm->start = monotonicSeconds();
+    tm->soft = INFINITY;
+    tm->hard = INFINITY;
+
+    if (limits->infinite) { return; }
+
+    if (limits->move_time > 0)
+    {
+        tm->soft = tm->hard = MAX(limits->move_time - MOVE_OVERHEAD, 0.01);
+    }
+    else if (limits->time_left > 0)
+    {
+        int moves_to_go = limits->moves_to_go > 0 ? limits->moves_to_go : DEFAULT_MOVES_TO_GO;
+        double usable = MAX(limits->time_left - MOVE_OVERHEAD, 0.01);
+
+        // Aim for an even share of the remaining time plus most of the
+        // increment, but allow overrunning that several times over when an
+        // iteration is in progress, as long as plenty of time is left.
+        tm->soft = usable / moves_to_go + limits->increment * 0.75;
+        tm->hard = MIN(tm->soft * 4, usable / 2);
+        tm->soft = MIN(tm->soft, tm->hard);
+    }
+}
+
+static inline double elapsedSeconds(const struct timeManager *tm)
+{
+    return monotonicSeconds() - tm->start;
+}
+
+#endif // TIMEMAN_H
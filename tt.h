@@ -0,0 +1,194 @@
+#ifndef TT_H
+#define TT_H
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "moves.h"
+
+/*
+ * The transposition table remembers what earlier searches found out about
+ * a position, keyed on its Zobrist hash: the score, whether that score is
+ * exact or only a bound, how deep the search went, and the best move. It
+ * saves re-searching positions reached by transposition, and between
+ * iterative-deepening iterations it supplies the best move to try first.
+ * https://www.chessprogramming.org/Transposition_Table
+ *
+ * Entries are grouped into clusters that share one cache line. A position
+ * can live in any entry of the cluster its hash selects.
+ *
+ * Search threads share the table without locks. Everything but the key is
+ * packed into one 64-bit word, and the key is stored XORed with that word,
+ * so an entry torn by two threads writing at once simply fails to match.
+ * https://www.chessprogramming.org/Shared_Hash_Table#Lockless
+ */
+
+#define TT_DEFAULT_MB 16
+#define TT_CLUSTER_SIZE 4
+#define TT_CACHE_LINE 64
+
+// The kind of score stored: exact, or only a bound from an alpha-beta cutoff.
+#define BOUND_NONE  0
+#define BOUND_UPPER 1
+#define BOUND_LOWER 2
+#define BOUND_EXACT 3
+
+// An entry as probeTT() returns it.
+struct ttEntry
+{
+    int score;
+    struct move move;
+    int depth;
+    int bound;
+    int age;
+};
+
+/*
+ * An entry as stored. data holds, from the low bits up:
+ * bound (2 bits), age (6 bits), depth (8 bits), move (16 bits), score (32 bits).
+ */
+struct ttSlot
+{
+    uint64_t key;
+    uint64_t data;
+};
+
+struct ttCluster
+{
+    struct ttSlot slots[TT_CLUSTER_SIZE];
+} __attribute__((aligned(TT_CACHE_LINE)));
+
+struct ttCluster *tt_table = NULL;
+uint64_t tt_mask;
+uint8_t tt_age;
+
+void clearTT()
+{
+    memset(tt_table, 0, sizeof(struct ttCluster) * (tt_mask + 1));
+    tt_age = 0;
+}
+
+/*
+ * (Re)allocate the table, rounding its size down to a power of two clusters,
+ * each aligned to a cache line. Returns false, keeping the old table, if
+ * the memory cannot be had.
+ */
+bool initTT(int size_mb)
+{
+    size_t n_clusters = 1;
+    size_t bytes = (size_t) size_mb * 1024 * 1024;
+    while (n_clusters * 2 * sizeof(struct ttCluster) <= bytes)
+    {
+        n_clusters *= 2;
+    }
+
+    struct ttCluster *table = aligned_alloc(TT_CACHE_LINE, n_clusters * sizeof(struct ttCluster));
+    if (table == NULL) { return false; }
+
+    free(tt_table);
+    tt_table = table;
+    tt_mask = n_clusters - 1;
+    clearTT();
+    return true;
+}
+
+// Called once per search, so that entries from old searches are replaced first.
+void newSearchTT()
+{
+    tt_age = (tt_age + 1) & 63;
+}
+
+static inline struct ttCluster *clusterFor(uint64_t key)
+{
+    return &tt_table[key & tt_mask];
+}
+
+static inline uint64_t packEntry(int score, struct move m, int depth, int bound, int age)
+{
+    return ((uint64_t) (uint32_t) score << 32) | ((uint64_t) m.data << 16)
+        | ((uint64_t) (uint8_t) depth << 8) | (age << 2) | bound;
+}
+
+static inline struct ttEntry unpackEntry(uint64_t data)
+{
+    return (struct ttEntry) {
+        .score = (int32_t) (data >> 32),
+        .move = { (uint16_t) (data >> 16) },
+        .depth = (int8_t) (data >> 8),
+        .bound = data & 3,
+        .age = (data >> 2) & 63
+    };
+}
+
+// Read a slot as (key, data), with the key already un-XORed.
+static inline void loadSlot(const struct ttSlot *slot, uint64_t *key, uint64_t *data)
+{
+    *data = __atomic_load_n(&slot->data, __ATOMIC_RELAXED);
+    *key = __atomic_load_n(&slot->key, __ATOMIC_RELAXED) ^ *data;
+}
+
+// Look up a position. On a hit, copies the entry into *entry.
+bool probeTT(uint64_t key, struct ttEntry *entry)
+{
+    struct ttCluster *cluster = clusterFor(key);
+    for (int i = 0; i < TT_CLUSTER_SIZE; i++)
+    {
+        uint64_t slot_key, data;
+        loadSlot(&cluster->slots[i], &slot_key, &data);
+        if (slot_key == key && (data & 3) != BOUND_NONE)
+        {
+            *entry = unpackEntry(data);
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Store a search result. An entry for the same position is always
+ * overwritten. Otherwise the victim is the entry with the least value:
+ * entries from older searches are worth less, then shallower ones.
+ */
+void storeTT(uint64_t key, int depth, int score, int bound, struct move m)
+{
+    struct ttCluster *cluster = clusterFor(key);
+    struct ttSlot *victim = &cluster->slots[0];
+    struct ttEntry old = { 0 };
+    int victim_value = INT_MAX;
+
+    for (int i = 0; i < TT_CLUSTER_SIZE; i++)
+    {
+        uint64_t slot_key, data;
+        loadSlot(&cluster->slots[i], &slot_key, &data);
+        struct ttEntry e = unpackEntry(data);
+
+        if (slot_key == key)
+        {
+            victim = &cluster->slots[i];
+            old = e;
+            break;
+        }
+
+        int age_diff = (tt_age - e.age) & 63;
+        int value = e.depth - 8 * age_diff;
+        if (value < victim_value)
+        {
+            victim = &cluster->slots[i];
+            victim_value = value;
+        }
+    }
+
+    // Keep an old best move rather than forget it
+    if (m.data == NO_MOVE.data)
+    {
+        m = old.move;
+    }
+
+    uint64_t data = packEntry(score, m, depth, bound, tt_age);
+    __atomic_store_n(&victim->key, key ^ data, __ATOMIC_RELAXED);
+    __atomic_store_n(&victim->data, data, __ATOMIC_RELAXED);
+}
+
+#endif // TT_H
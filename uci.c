@@ -0,0 +1,300 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "board.h"
+#include "moves.h"
+#include "ai.h"
+
+/*
+ * A front end speaking the Universal Chess Interface, for GUIs and match
+ * managers. Commands are read from stdin while the search runs on a thread
+ * of its own, so that "stop", "ponderhit" and "isready" are answered at
+ * once.
+ * https://www.chessprogramming.org/UCI
+ */
+
+#define START_FEN "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"
+
+// Long enough for a "position" command listing every move of a long game
+#define MAX_LINE 65536
+
+#define MAX_HASH_MB 65536
+#define MAX_THREADS 256
+
+struct board position;
+
+// The search thread, its own copy of the position and its limits
+pthread_t search_thread;
+bool searching = false;
+struct board search_board;
+struct searchLimits uci_limits;
+
+// An infinite or ponder search must not send its best move until told to
+// stop (or, for ponder, that the opponent played the expected move).
+bool wait_for_stop = false;
+pthread_mutex_t wait_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t wait_cond = PTHREAD_COND_INITIALIZER;
+
+// Write a score in UCI terms: centipawns, or moves to mate.
+int formatScore(char *str, size_t size, int score)
+{
+    if (score >= MATE_BOUND)
+    {
+        return snprintf(str, size, "score mate %d", (MATE_SCORE - score + 1) / 2);
+    }
+    if (score <= -MATE_BOUND)
+    {
+        return snprintf(str, size, "score mate %d", -(MATE_SCORE + score) / 2);
+    }
+    return snprintf(str, size, "score cp %d", score);
+}
+
+/*
+ * Print an info line for an iteration. It is built up first and printed
+ * whole, so that it cannot be interleaved with replies from the other thread.
+ */
+void printInfo(const struct searchReport *report)
+{
+    char info[128 + MAX_PLY * 6];
+    long long int ms = (long long int) (report->seconds * 1000);
+    long long int nps = report->seconds > 0 ? (long long int) (report->nodes / report->seconds) : 0;
+
+    int len = snprintf(info, sizeof(info), "info depth %d ", report->depth);
+    len += formatScore(info + len, sizeof(info) - len, report->score);
+    len += snprintf(info + len, sizeof(info) - len, " nodes %lld nps %lld time %lld pv",
+            report->nodes, nps, ms);
+    for (int i = 0; i < report->pv_length; i++)
+    {
+        char move_str[6];
+        moveString(report->pv[i], move_str);
+        len += snprintf(info + len, sizeof(info) - len, " %s", move_str);
+    }
+
+    printf("%s\n", info);
+    fflush(stdout);
+}
+
+void *searchMain(void *arg)
+{
+    (void) arg;
+    struct move best = searchPosition(&search_board, &uci_limits);
+
+    pthread_mutex_lock(&wait_lock);
+    while (wait_for_stop)
+    {
+        pthread_cond_wait(&wait_cond, &wait_lock);
+    }
+    pthread_mutex_unlock(&wait_lock);
+
+    char move_str[6] = "0000";
+    if (best.data != NO_MOVE.data) { moveString(best, move_str); }
+    printf("bestmove %s\n", move_str);
+    fflush(stdout);
+    return NULL;
+}
+
+// Let a finished infinite or ponder search send its best move.
+void releaseSearch()
+{
+    pthread_mutex_lock(&wait_lock);
+    wait_for_stop = false;
+    pthread_cond_signal(&wait_cond);
+    pthread_mutex_unlock(&wait_lock);
+}
+
+// Stop the search, if any, and wait for it to send its best move.
+void stopSearch()
+{
+    if (!searching) { return; }
+
+    requestStop();
+    releaseSearch();
+    pthread_join(search_thread, NULL);
+    searching = false;
+}
+
+// "position [startpos | fen <fen>] [moves <move>...]"
+void uciPosition(char *args)
+{
+    char *moves = strstr(args, "moves");
+    if (moves != NULL) { *moves = '\0'; }
+
+    init_board(&position);
+    char *fen = strstr(args, "fen");
+    apply_FEN(&position, fen != NULL ? fen + 3 + strspn(fen + 3, " ") : START_FEN);
+
+    if (moves != NULL && !applyMoveStrings(&position, moves + 5))
+    {
+        printf("info string illegal move in position command\n");
+    }
+}
+
+// "go [wtime <ms>] [btime <ms>] [winc <ms>] [binc <ms>] [movestogo <n>]
+//     [movetime <ms>] [depth <n>] [nodes <n>] [infinite] [ponder]"
+void uciGo(char *args)
+{
+    struct searchLimits limits = { 0 };
+    bool white = position.white_to_move;
+
+    for (char *token = strtok(args, " "); token != NULL; token = strtok(NULL, " "))
+    {
+        if (strcmp(token, "infinite") == 0) { limits.infinite = true; continue; }
+        if (strcmp(token, "ponder") == 0) { limits.ponder = true; continue; }
+
+        char *value = strtok(NULL, " ");
+        if (value == NULL) { break; }
+
+        if (strcmp(token, (white ? "wtime" : "btime")) == 0) { limits.time_left = atof(value) / 1000; }
+        else if (strcmp(token, (white ? "winc" : "binc")) == 0) { limits.increment = atof(value) / 1000; }
+        else if (strcmp(token, "movestogo") == 0) { limits.moves_to_go = atoi(value); }
+        else if (strcmp(token, "movetime") == 0) { limits.move_time = atof(value) / 1000; }
+        else if (strcmp(token, "depth") == 0) { limits.depth = atoi(value); }
+        else if (strcmp(token, "nodes") == 0) { limits.nodes = atoll(value); }
+    }
+
+    search_board = position;
+    uci_limits = limits;
+    wait_for_stop = limits.infinite || limits.ponder;
+    prepareSearch(&limits);
+    searching = true;
+    pthread_create(&search_thread, NULL, searchMain, NULL);
+}
+
+// "setoption name <name> [value <value>]"
+void uciSetOption(char *args)
+{
+    char *name = strstr(args, "name");
+    if (name == NULL) { return; }
+    name += 4 + strspn(name + 4, " ");
+
+    char *value = strstr(name, " value");
+    if (value != NULL)
+    {
+        *value = '\0';
+        value += 6 + strspn(value + 6, " ");
+    }
+    else
+    {
+        value = "";
+    }
+
+    if (strcmp(name, "Hash") == 0)
+    {
+        if (!initTT(MIN(MAX(atoi(value), 1), MAX_HASH_MB)))
+        {
+            printf("info string could not allocate %s MB for the hash table\n", value);
+        }
+    }
+    else if (strcmp(name, "Threads") == 0)
+    {
+        setThreads(MIN(MAX(atoi(value), 1), MAX_THREADS));
+    }
+    else if (strcmp(name, "Ponder") == 0)
+    {
+        // Nothing to set up: the GUI decides when to "go ponder"
+    }
+    else if (strcmp(name, "NullMove") == 0)
+    {
+        search_options.null_move = strcmp(value, "true") == 0;
+    }
+    else if (strcmp(name, "LMR") == 0)
+    {
+        search_options.lmr = strcmp(value, "true") == 0;
+    }
+    else if (strcmp(name, "EvalFile") == 0)
+    {
+        if (*value == '\0' || strcmp(value, "<empty>") == 0)
+        {
+            nnueUnload();
+        }
+        else if (!nnueLoad(value))
+        {
+            printf("info string could not load network %s\n", value);
+        }
+    }
+    else
+    {
+        printf("info string unknown option %s\n", name);
+    }
+}
+
+void uciIdentify()
+{
+    printf("id name Chest\n");
+    printf("id author Nolan Nicholson\n");
+    printf("option name Hash type spin default %d min 1 max %d\n", TT_SIZE_MB, MAX_HASH_MB);
+    printf("option name Threads type spin default 1 min 1 max %d\n", MAX_THREADS);
+    printf("option name Ponder type check default false\n");
+    printf("option name NullMove type check default true\n");
+    printf("option name LMR type check default true\n");
+    printf("option name EvalFile type string default <empty>\n");
+    printf("uciok\n");
+}
+
+int main(void)
+{
+    static char line[MAX_LINE];
+
+    init_board(&position);
+    apply_FEN(&position, START_FEN);
+    initComputer();
+    report_iteration = printInfo;
+
+    while (fgets(line, sizeof(line), stdin) != NULL)
+    {
+        line[strcspn(line, "\r\n")] = '\0';
+
+        char *args = line + strcspn(line, " ");
+        if (*args != '\0') { *args++ = '\0'; }
+
+        if (strcmp(line, "uci") == 0)
+        {
+            uciIdentify();
+        }
+        else if (strcmp(line, "isready") == 0)
+        {
+            printf("readyok\n");
+        }
+        else if (strcmp(line, "ucinewgame") == 0)
+        {
+            stopSearch();
+            clearTT();
+        }
+        else if (strcmp(line, "position") == 0)
+        {
+            stopSearch();
+            uciPosition(args);
+        }
+        else if (strcmp(line, "go") == 0)
+        {
+            stopSearch();
+            uciGo(args);
+        }
+        else if (strcmp(line, "stop") == 0)
+        {
+            stopSearch();
+        }
+        else if (strcmp(line, "ponderhit") == 0)
+        {
+            ponderHit();
+            releaseSearch();
+        }
+        else if (strcmp(line, "setoption") == 0)
+        {
+            stopSearch();
+            uciSetOption(args);
+        }
+        else if (strcmp(line, "quit") == 0)
+        {
+            break;
+        }
+
+        fflush(stdout);
+    }
+
+    stopSearch();
+    return 0;
+}